@@ -0,0 +1,260 @@
+/*
+ bench.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_BENCH_HPP_
+#define TRAX_BENCH_HPP_
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "kizuna.h"
+
+namespace Trax{
+    
+    /**************************ベンチマーク**************************/
+    
+    // 固定局面集を固定深さで探索し、探索速度と探索ノード数を測る
+    // 1スレッドなら乱数と置換表を毎回初期化するので探索ノード数が再現し、
+    // 合計ノード数(シグネチャ)が変わったら探索の動作が変わったことがわかる
+    // スレッド数を変えて同じ局面集を探索すると並列探索の効率もわかる
+    
+    constexpr int kBenchDepth = 5;
+    
+    // 序盤から終盤までの局面(-R ... -F と同じ棋譜表記)
+    const std::vector<std::string> benchRecords = {
+        "@0/ @1+ A0/ B3\\ C3\\ C4+ D3/ C2+",
+        "@0/ @1+ A0/ B3\\ C3\\ C4+ D3/ C2+ C1/ D1/ E1+ E0/ F1/ E5+ F4\\ G3\\",
+        "@0/ @1+ A0/ B3\\ C3\\ C4+ D3/ C2+ C1/ D1/ E1+ E0/ F1/ E5+ F4\\ G3\\ F0+ F0/ G4+ D3+ D1/ G1\\ E8\\ F8\\ G8\\ H7+",
+        "@0/ @1+ A0/ B3\\ C3\\ C4+ D3/ C2+ C1/ D1/ E1+ E0/ F1/ E5+ F4\\ G3\\ F0+ F0/ G4+ D3+ D1/ G1\\ E8\\ F8\\ G8\\ H7+ I5+ @5\\ A3/ B2\\ B7+ I2+ J3/ K2\\ B8\\ B1+",
+        "@0+ @1\\ @1+ @1\\ D2/ E2\\ E3\\ C3+",
+        "@0+ @1\\ @1+ @1\\ D2/ E2\\ E3\\ C3+ F2/ F1/ A2+ G2+ F0/ E0\\ D1\\ A2\\",
+        "@0+ A0\\ @1/ B3\\ C1+ C2+ @1/ B0+",
+        "@0+ A0\\ @1/ B3\\ C1+ C2+ @1/ B0+ B0/ B0/ @4+ F6\\ E7/ C0\\ B1\\ A1\\",
+        "@0+ @1/ A0/ @1+ @1/ @1/ C0\\ @1+",
+        "@0+ @1/ A0/ @1+ @1/ @1/ C0\\ @1+ B0\\ B0\\ A1\\ @4\\ E1+ B0+ E7+ F7\\",
+        "@0+ B1+ A2/ B0\\ A4/ C2+ C1+ C0\\",
+        "@0+ B1+ A2/ B0\\ A4/ C2+ C1+ C0\\ @5\\ E3+ E2+ E4\\ E5+ C5+ C6\\ @5\\",
+        "@0+ B1+ A2/ B0\\ A4/ C2+ C1+ C0\\ @5\\ E3+ E2+ E4\\ E5+ C5+ C6\\ @5\\ C7\\ E7+ A4\\ E0/ F1/ F0/ G1/ G0/ H4+ D1+",
+        "@0/ A0/ @2\\ A3/ @2\\ @2\\ D0/ C5/",
+        "@0/ A0/ @2\\ A3/ @2\\ @2\\ D0/ C5/ D4+ D6+ A2\\ @3/ A4/ C5/ B6+ F1/",
+        "@0/ A0/ @2\\ A3/ @2\\ @2\\ D0/ C5/ D4+ D6+ A2\\ @3/ A4/ C5/ B6+ F1/ G2/ H4/ @4+ A1+ @3/ J5\\ K5\\ G0+ E2+ B1/",
+        "@0+ A0/ A3\\ B1/ B0/ C4+ A0\\ @1\\",
+        "@0+ A0/ A3\\ B1/ B0/ C4+ A0\\ @1\\ E4+ B0\\ D7\\ E7\\ F7+ D8+ F3/ G6+",
+        "@0+ B1/ A0/ C2+ C3/ A3+ @2\\ @2\\",
+        "@0+ B1/ A0/ C2+ C3/ A3+ @2\\ @2\\ B0+ D2+ @1\\ A0\\ C1+ B0+ C6+ @3+",
+        "@0+ B1/ A0/ C2+ C3/ A3+ @2\\ @2\\ B0+ D2+ @1\\ A0\\ C1+ B0+ C6+ @3+ @2/ A1/ @1+ D0/ F1\\ @3/ A4/ B5/ C6/ F8\\",
+        "@0/ @1+ B2/ C1/ C0/ B0/ D4+ B5/",
+        "@0/ @1+ B2/ C1/ C0/ B0/ D4+ B5/ D1/ E1/ B0+ D7\\ E5\\ C8\\ C9+ F5\\",
+        "@0/ A2+ A0+ A0+ A5/ B4/ A6+ A7/",
+        "@0/ A2+ A0+ A0+ A5/ B4/ A6+ A7/ @2+ B0/ @4\\ B6\\ D2\\ @5/ A6/ C7+",
+        "@0/ A2+ A0+ A0+ A5/ B4/ A6+ A7/ @2+ B0/ @4\\ B6\\ D2\\ @5/ A6/ C7+ @7\\ B8+ D9+ F8\\ F9\\ G1/ E0/ G5+ H2+ @9/",
+        "@0+ @1+ B0\\ B3\\ B4\\ A3/ @2/ C5\\",
+        "@0+ @1+ B0\\ B3\\ B4\\ A3/ @2/ C5\\ C0\\ A2+ D5+ E3\\ @3+ C6+ F2+ E1+",
+        "@0/ @1+ A0\\ B0+ B4/ C2\\ B0/ C0\\",
+        "@0/ @1+ A0\\ B0+ B4/ C2\\ B0/ C0\\ C0\\ A2+ @3\\ E3+ A6+ @3\\ C8/ B8/",
+        "@0+ B1+ A0+ A0+ C3+ A4/ C4+ C5\\",
+        "@0+ B1+ A0+ A0+ C3+ A4/ C4+ C5\\ C2/ B5/ C6\\ C7\\ D2+ @3\\ E1/ C1/",
+        "@0+ B1+ A0+ A0+ C3+ A4/ C4+ C5\\ C2/ B5/ C6\\ C7\\ D2+ @3\\ E1/ C1/ @3+ @4\\ A2/ A1/ @1+ @2+ I5+ J3+ E0\\ C1\\",
+        "@0/ @1+ A0/ B1+ B3+ C2+ @1+ A2+",
+        "@0/ @1+ A0/ B1+ B3+ C2+ @1+ A2+ D1+ A0\\ A0+ C1\\ A0/ @3+ D0/ E1/",
+        "@0/ @1+ A0/ B1+ B3+ C2+ @1+ A2+ D1+ A0\\ A0+ C1\\ A0/ @3+ D0/ E1/ @4\\ @4\\ A5\\ F0+ @6/ C7/ E2+ E8\\ I1\\ H3+",
+        "@0/ @1+ A0/ B1+ B3+ C2+ @1+ A2+ D1+ A0\\ A0+ C1\\ A0/ @3+ D0/ E1/ @4\\ @4\\ A5\\ F0+ @6/ C7/ E2+ E8\\ I1\\ H3+ I0/ J1/ @6\\ A5\\ I0\\ G2+ D11/ C11/ B11+ F12\\",
+        "@0/ @1/ C1/ B2/ C3+ D2\\ C4/ D3\\",
+        "@0/ @1/ C1/ B2/ C3+ D2\\ C4/ D3\\ D5+ A3+ E3+ E5\\ F5+ D6+ F1/ B0+",
+        "@0/ A2/ @2/ B3+ C1/ @1\\ C0+ B5\\",
+        "@0/ A2/ @2/ B3+ C1/ @1\\ C0+ B5\\ @2+ F4/ C6\\ A4\\ @3+ @4\\ E0\\ C2+",
+        "@0/ A2/ @2/ B3+ C1/ @1\\ C0+ B5\\ @2+ F4/ C6\\ A4\\ @3+ @4\\ E0\\ C2+ A6+ @5/ I3+ J5\\ J6\\ K4/ K3/ H1\\ G0/ D8/",
+        "@0/ A2/ @2/ B3+ C1/ @1\\ C0+ B5\\ @2+ F4/ C6\\ A4\\ @3+ @4\\ E0\\ C2+ A6+ @5/ I3+ J5\\ J6\\ K4/ K3/ H1\\ G0/ D8/ D9/ L4/ K3\\ K2\\ I1/ J0\\ L9+ M6+ H9/ E3+",
+        "@0/ A0/ B1+ A0+ @1\\ C1+ D3+ D4\\"
+    };
+    
+    struct BenchResult{
+        int positions = 0; // 探索した局面数
+        uint64_t nodes = 0;
+        uint64_t timeMs = 0;
+        uint64_t ttProbes = 0, ttHits = 0; // 置換表を引いた回数と見つかった回数
+        uint64_t visits = 0, duplicates = 0; // 重複探索の計測をした場合の探索局面数と重複数
+    };
+    
+    BenchResult benchSuite(int depth, std::ostream *const post, bool only8x8 = false, bool on8x8Board = false,
+                           int position = -1){
+        // 局面集の全局面を Global::numThreads スレッドで探索する
+        // post があれば局面ごとの結果を書く
+        // only8x8 なら 8x8 に収まる局面だけを探索し、on8x8Board ならそれを Board8x8 で探索する
+        // position >= 0 ならその番号の局面だけを探索する
+        const bool variant8x8 = Global::variant8x8;
+        const int depthLimit = Global::searchDepthLimit;
+        const bool reportStopLatency = Global::reportStopLatency;
+        Global::variant8x8 = on8x8Board;
+        Global::searchDepthLimit = depth;
+        Global::reportStopLatency = false; // 固定深さなので停止の遅れは意味を持たない
+        Global::manager.SetNumSearchThreads(Global::numThreads);
+        
+        BenchResult total;
+        for(size_t i = 0; i < benchRecords.size(); ++i){
+            if(position >= 0 && int(i) != position){ continue; }
+            Board& bd = Global::rootBoard;
+            bd.clear();
+            int ret = 0;
+            for(const std::string& str : split(benchRecords[i], ' ')){
+                const Move mv = readMoveNotation(str, bd);
+                ret = (mv == kMoveNone) ? -1 : bd.makeMove(mv);
+                if(ret != 0){ break; }
+            }
+            if(ret != 0){
+                if(post != nullptr){
+                    *post << "position " << (i + 1) << " is broken : " << benchRecords[i] << endl;
+                }
+                continue;
+            }
+            if(only8x8 && !Global::fits8x8Node(bd)){ continue; }
+            
+            // 探索が再現するように状態を初期化する
+            Global::tt.Clear();
+            Global::evalHash.Clear();
+            if(Global::visitTable != nullptr){
+                Global::visitTable->Clear();
+            }
+            Global::dice.srand(1);
+            Global::rootColor = bd.turnColor();
+            Global::syncNodes();
+            Global::signals = 0;
+            Global::clock.start();
+            ClockMS clock;
+            clock.start();
+            auto best = Global::visitNode(0, [](auto& node)->MoveScoreDepth{
+                using node_t = std::decay_t<decltype(node)>;
+                MoveScoreDepth best = Global::manager.ParallelSearch(node, {}, {}, 1);
+                best.set(convertMove<node_t::size(), SIZE>(Move(best)));
+                return best;
+            });
+            const uint64_t timeMs = clock.stop();
+            const uint64_t nodes = Global::manager.CountNodesSearched();
+            
+            if(post != nullptr){
+                *post << "position " << (i + 1) << " / " << benchRecords.size()
+                << " turn " << bd.turn << " best " << toNotationString(Move(best), bd) << " score " << best.score
+                << " nodes " << nodes << " time-to-depth " << timeMs << " ms" << endl;
+            }
+            total.positions += 1;
+            total.nodes += nodes;
+            total.timeMs += timeMs;
+            total.ttProbes += Global::ttProbes;
+            total.ttHits += Global::ttHits;
+            if(Global::visitTable != nullptr){
+                total.visits += Global::visitTable->visits();
+                total.duplicates += Global::visitTable->duplicates();
+            }
+        }
+        
+        Global::variant8x8 = variant8x8;
+        Global::searchDepthLimit = depthLimit;
+        Global::reportStopLatency = reportStopLatency;
+        return total;
+    }
+    
+    BenchResult bench(int depth, std::ostream& ost){
+        // 局面集の全局面を探索して、局面ごとの結果と合計を ost に書く
+        const BenchResult total = benchSuite(depth, &ost);
+        
+        ost << "===========================" << endl;
+        ost << "depth          : " << depth << endl;
+        ost << "threads        : " << Global::numThreads << endl;
+        ost << "total time(ms) : " << total.timeMs << endl;
+        ost << "nodes searched : " << total.nodes << endl;
+        ost << "nodes/second   : " << (total.nodes * 1000 / max(total.timeMs, uint64_t(1))) << endl;
+        ost << "time-to-depth  : " << (total.timeMs / benchRecords.size()) << " ms (average)" << endl;
+        ost << "signature      : " << total.nodes << (Global::numThreads > 1 ? " (not reproducible with threads > 1)" : "") << endl;
+        return total;
+    }
+    
+    void bench8x8(int depth, std::ostream& ost){
+        // 8x8 に収まる局面を通常の盤面と Board8x8 で同じ深さまで探索し、探索速度を比べる
+        // 計測時間のぶれを抑えるため、局面ごとに両方を交互に kRounds 回ずつ探索し、最も速かった回の時間を足し合わせる
+        constexpr int kRounds = 5;
+        std::array<BenchResult, 2> total;
+        for(int p = 0; p < int(benchRecords.size()); ++p){
+            std::array<BenchResult, 2> best;
+            for(int r = 0; r < kRounds; ++r){
+                for(int i = 0; i < 2; ++i){
+                    std::ostringstream oss;
+                    const BenchResult result = benchSuite(depth, r == 0 ? &oss : nullptr, true, i == 1, p);
+                    if(r == 0 && result.positions > 0){
+                        ost << (i == 0 ? "normal       : " : "8x8 bitboard : ") << oss.str();
+                    }
+                    if(r == 0 || result.timeMs < best[i].timeMs){
+                        best[i] = result;
+                    }
+                }
+            }
+            for(int i = 0; i < 2; ++i){
+                total[i].positions += best[i].positions;
+                total[i].nodes += best[i].nodes;
+                total[i].timeMs += best[i].timeMs;
+            }
+        }
+        const BenchResult& normal = total[0];
+        const BenchResult& bitboard = total[1];
+        
+        ost << "===========================" << endl;
+        ost << "depth " << depth << ", " << normal.positions << " positions within 8 x 8, "
+        << Global::numThreads << " threads, best of " << kRounds << " rounds per position" << endl;
+        ost << "board          time(ms)        nodes   nodes/s" << endl;
+        for(int i = 0; i < 2; ++i){
+            const BenchResult& r = (i == 0) ? normal : bitboard;
+            ost << (i == 0 ? "normal      " : "8x8 bitboard")
+            << std::setw(11) << r.timeMs
+            << std::setw(13) << r.nodes
+            << std::setw(10) << (r.nodes * 1000 / max(r.timeMs, uint64_t(1))) << endl;
+        }
+        const double normalNps = normal.nodes * 1000.0 / max(normal.timeMs, uint64_t(1));
+        const double bitboardNps = bitboard.nodes * 1000.0 / max(bitboard.timeMs, uint64_t(1));
+        ost << "8x8 bitboard / normal nodes/s : " << std::fixed << std::setprecision(2)
+        << (bitboardNps / max(normalNps, 1.0)) << endl;
+    }
+    
+    void scalingBench(int depth, int maxThreads, std::ostream& ost){
+        // 1, 2, 4, ... maxThreads スレッドで局面集を探索し、並列探索の効率を測る
+        // NPS と time-to-depth の 1 スレッドとの比、置換表のヒット率、
+        // 他のスレッドがすでに探索した局面を探索した割合(重複率)を出す
+        const int numThreads = Global::numThreads;
+        NodeVisitTable visitTable;
+        visitTable.SetSize(64);
+        Global::visitTable = &visitTable;
+        
+        std::vector<int> threads;
+        for(int th = 1; th < maxThreads; th *= 2){
+            threads.push_back(th);
+        }
+        threads.push_back(maxThreads);
+        
+        ost << "depth " << depth << ", " << benchRecords.size() << " positions" << endl;
+        ost << "threads   time(ms)        nodes   nodes/s  NPS-scale  TTD-speedup  TT-hit  duplicated" << endl;
+        BenchResult base;
+        for(int th : threads){
+            Global::numThreads = th;
+            const BenchResult r = benchSuite(depth, nullptr);
+            if(th == 1){
+                base = r;
+            }
+            const double nps = r.nodes * 1000.0 / max(r.timeMs, uint64_t(1));
+            const double baseNps = base.nodes * 1000.0 / max(base.timeMs, uint64_t(1));
+            ost << std::fixed << std::setprecision(2)
+            << std::setw(7) << th
+            << std::setw(11) << r.timeMs
+            << std::setw(13) << r.nodes
+            << std::setw(10) << uint64_t(nps)
+            << std::setw(11) << (nps / baseNps)
+            << std::setw(13) << (double(base.timeMs) / max(r.timeMs, uint64_t(1)))
+            << std::setw(7) << std::setprecision(1) << (100.0 * r.ttHits / max(r.ttProbes, uint64_t(1))) << "%"
+            << std::setw(11) << (100.0 * r.duplicates / max(r.visits, uint64_t(1))) << "%" << endl;
+        }
+        
+        Global::visitTable = nullptr;
+        Global::numThreads = numThreads;
+        Global::manager.SetNumSearchThreads(numThreads);
+    }
+}
+
+#endif // TRAX_BENCH_HPP_
@@ -6,38 +6,53 @@
 #ifndef TRAX_BOARD_HPP_
 #define TRAX_BOARD_HPP_
 
-#include "eval_params.h"
-
 #include "trax.hpp"
 #include "board_elements.hpp"
+#include "params.hpp"
 
 namespace Trax{
     
     /**************************盤面表現**************************/
     
-    class Board{
+    template<int kSize>
+    class BoardT{
         // 2次元を基本とした盤面表現
+        // 一辺のマス数 kSize をコンパイル時に決めることで、小さい盤面では配列も近傍のストライドも小さくなる
         
     public:
-        static constexpr int size()noexcept{ return SIZE; }
+        static constexpr int size()noexcept{ return kSize; }
         static constexpr int margin()noexcept{ return MARGIN; }
         
+        // 盤面サイズごとの座標系
+        static constexpr int ar4[4] = { -kSize, -1, +kSize, +1, };
+        static constexpr int ZtoX(unsigned int z)noexcept{ return z / kSize; }
+        static constexpr int ZtoY(unsigned int z)noexcept{ return z % kSize; }
+        static constexpr int XYtoZ(unsigned int x, unsigned int y)noexcept{ return x * kSize + y; }
+        static constexpr int Z_FIRST = (kSize / 2 - 1) * kSize + (kSize / 2 - 1);
+        static constexpr bool isOnBoard(int x, int y)noexcept{
+            return MARGIN <= x && x < kSize - MARGIN && MARGIN <= y && y < kSize - MARGIN;
+        }
+        using XY = XYT<kSize>;
+        
         int turn; // 現在の手数
         TileBound bound; // タイルの端の座標
         
         uint64_t hash; // hash value
+        std::array<uint64_t, 8> symmetryHash; // 対称変換ごとのハッシュ値(絶対座標基準)
 
         int moves; // これまでに置かれたタイルの数(手数と違うので注意)
         
-        std::array<LineInfo<SIZE>, N_TURNS> line_; // 線
+        std::array<LineInfo<kSize>, N_TURNS> line_; // 線
         int lines;
         
         std::array<MoveInfo, N_TURNS * 4> moveInfo;
         std::array<TurnInfo, N_TURNS> turnInfo;
-        std::array<TileCell, SIZE * SIZE> cell_; // タイル情報
-        //std::array<LineRef, SIZE * SIZE * 4> lineRef; // 線へのリンク情報
-        std::array<EdgeInfo, SIZE * SIZE * 4> edgeInfo_; // エッジの情報
-        Straights<SIZE> straights_; // 直線の色情報
+        std::array<TileCell, kSize * kSize> cell_; // タイル情報
+        //std::array<LineRef, kSize * kSize * 4> lineRef; // 線へのリンク情報
+        std::array<EdgeInfo, kSize * kSize * 4> edgeInfo_; // エッジの情報
+#ifdef USE_STRAIGHT
+        Straights<kSize> straights_; // 直線の色情報
+#endif
         
         // 以下評価のための情報(差分計算される)
         //std::array<std::array<int, 16 * 16>, 2> frontShapeLines; // 各線のエンドの距離型
@@ -53,8 +68,6 @@ namespace Trax{
         std::array<int, 2> longLines; // ビクトリーラインを伺える線の数
         //std::array<double, 2> sumInvLineEndMD; // 各線のエンド間のマンハッタン距離の逆数
         
-        std::array<std::array<int, 16 * 16>, 2> twoLinesFrontShape; // 2線関係
-        
         int modifiedLatestLineAge; // 変化させた最も新しい線の世代
         
         // 評価値
@@ -74,9 +87,6 @@ namespace Trax{
                 //end2endLines[c].fill(0);
                 //frontShapeLines[c].fill(0);
             }
-            for(int c = 0; c < 2; ++c){
-                //twoLinesFrontShape[c].fill(0);
-            }
             //twoLinesFrontShapeScore.fill(0);
             lineShapeScore.fill(0);
             twoLinesFrontShapeScore.fill(0);
@@ -98,12 +108,16 @@ namespace Trax{
         //int lines(const Color c)const{ return lines_[c]; }
         //int lines()const{ return lines_[0] + lines_[1]; }
  
+        Move pathMove(int t)const{
+            // ターン t の着手を得る
+            int idx = moveIndex(t);
+            return Move(moveInfo[idx].z, moveInfo[idx].tile);
+        }
         std::vector<Move> getPath()const{
             // これまでの着手列を得る
             std::vector<Move> v;
             for(int t = 0; t < turn; ++t){
-                int idx = moveIndex(t);
-                v.emplace_back(Move(moveInfo[idx].z, moveInfo[idx].tile));
+                v.emplace_back(pathMove(t));
             }
             return v;
         }
@@ -173,11 +187,11 @@ namespace Trax{
         Tile& tile(int z){ return cell_[z].tile; }
         const Tile& tile(int z)const{ return cell_[z].tile; }
         
-        //LineInfo<SIZE>& line(Color c, int l){ return line_[l * 2 + c]; }
-        //const LineInfo<SIZE>& line(Color c, int l)const{ return line_[l][c]; }
+        //LineInfo<kSize>& line(Color c, int l){ return line_[l * 2 + c]; }
+        //const LineInfo<kSize>& line(Color c, int l)const{ return line_[l][c]; }
         
-        LineInfo<SIZE>& line(int l){ return line_[l]; }
-        const LineInfo<SIZE>& line(int l)const{ return line_[l]; }
+        LineInfo<kSize>& line(int l){ return line_[l]; }
+        const LineInfo<kSize>& line(int l)const{ return line_[l]; }
         
         EdgeInfo& edgeInfo(int xyd){ return edgeInfo_[xyd]; }
         const EdgeInfo& edgeInfo(int xyd)const{ return edgeInfo_[xyd]; }
@@ -194,6 +208,11 @@ namespace Trax{
         }
         template<bool kPseudoLegality = false>
         int makeMove(int z, Tile tl, TileColor c){
+            if(kPseudoLegality && kSize < SIZE){
+                // 小さい盤面では探索中に盤端に達しうるので、置くタイルの盤外判定だけは行う
+                // (連鎖で置かれるタイルは境界の内側にしか置かれない)
+                if(!isOnBoard(ZtoX(z), ZtoY(z))){ return OUT_BOARD; }
+            }
             // makeMoveの前に行う処理
             turnInfo[turn].bound = bound;
             //turnInfo[turn].lineShapeScore = lineShapeScore;
@@ -226,6 +245,24 @@ namespace Trax{
             unmakeMove<kTurnCheck>(turn - 1);
         }
         
+        template<int kOtherSize>
+        bool syncWith(const BoardT<kOtherSize>& rhs){
+            // 盤面を rhs と同じ局面にする
+            // 共通の手順はそのまま残し、分岐点まで戻して rhs の着手を進める
+            // 通常は rhs が1, 2手進んだだけなので、棋譜の再生やコピーよりずっと軽い
+            // 盤面サイズが異なる場合は中央を揃えて着手を変換する
+            // 進められない着手(この盤面に収まらない等)があればそこで止めて false を返す
+            int t = 0;
+            const int tmax = min(turn, rhs.turn);
+            while(t < tmax && pathMove(t) == convertMove<kOtherSize, kSize>(rhs.pathMove(t))){ ++t; }
+            unmakeMove(t);
+            for(; t < rhs.turn; ++t){
+                if(makeMove<true>(convertMove<kOtherSize, kSize>(rhs.pathMove(t))) < 0){ return false; }
+            }
+            ASSERT(kOtherSize != kSize || hash == rhs.hash, cerr << toString() << rhs.toString(););
+            return true;
+        }
+        
         std::vector<Tile> rowTileVector(int x)const{
             std::vector<Tile> v;
             for(int y = ly() - 1; y <= hy() + 1; ++y){
@@ -357,7 +394,7 @@ namespace Trax{
         }
         
         template<int MODE = 0>
-        bool equals(const Board& rhs)const{
+        bool equals(const BoardT& rhs)const{
             if(turn != rhs.turn){
                 if(MODE){
                     cerr << "different |turn|" << endl;
@@ -387,7 +424,7 @@ namespace Trax{
                     }
                 }
             }
-            for(int z = 0; z < SIZE; ++z){
+            for(int z = 0; z < kSize; ++z){
                 if(color(z) != rhs.color(z)){
                     if(MODE){
                         cerr << "different color in " << z
@@ -396,7 +433,7 @@ namespace Trax{
                     return false;
                 }
             }
-            for(int z = 0; z < SIZE; ++z){
+            for(int z = 0; z < kSize; ++z){
                 if(tile(z) != rhs.tile(z)){
                     if(MODE){
                         cerr << "different tile in " << z
@@ -405,7 +442,7 @@ namespace Trax{
                     return false;
                 }
             }
-            for(int zd = 0; zd < SIZE * 4; ++zd){
+            for(int zd = 0; zd < kSize * 4; ++zd){
                 if(edgeInfo(zd) != rhs.edgeInfo(zd)){
                     if(MODE){
                         cerr << "different edge info " << zd
@@ -456,20 +493,28 @@ namespace Trax{
                 }
                 return false;
             }
-            if(!straights_.equals<MODE>(rhs.straights_)){
+            if(symmetryHash != rhs.symmetryHash){
+                if(MODE){
+                    cerr << "different symmetry hash value" << endl;
+                }
+                return false;
+            }
+#ifdef USE_STRAIGHT
+            if(!straights_.template equals<MODE>(rhs.straights_)){
                 if(MODE){
                     cerr << "different straights" << endl;
                 }
                 return false;
             }
+#endif
             return true;
         }
         
-        bool operator==(const Board& rhs)const{
+        bool operator==(const BoardT& rhs)const{
             return equals<0>(rhs);
         }
         
-        bool operator!=(const Board& rhs)const{
+        bool operator!=(const BoardT& rhs)const{
             return !((*this) == rhs);
         }
         
@@ -480,17 +525,24 @@ namespace Trax{
                 return false;
             }
             // color
-            for(int x = 0; x < SIZE; ++x){
-                for(int y = 0; y < SIZE; ++y){
+            std::array<uint64_t, 8> tsymHash;
+            tsymHash.fill(0ULL);
+            for(int x = 0; x < kSize; ++x){
+                for(int y = 0; y < kSize; ++y){
                     int z = XYtoZ(x, y);
                     if(tile(z) >= 0){
                         if(color(z) != tileColorTable[tile(z)]){
                             cerr << "Board::exam() : tile - color inconsistency" << endl;
                             return false;
                         }
+                        updateSymmetryHash<+1>(tsymHash, x, y, tile(z));
                     }
                 }
             }
+            if(tsymHash != symmetryHash){
+                cerr << "Board::exam() : inconsistent symmetry hash value" << endl;
+                return false;
+            }
             // line
             if(lines < 0){
                 cerr << "Board::exam() : illegal lines " << lines << endl;
@@ -523,8 +575,8 @@ namespace Trax{
                 }
             }
             // edge info
-            for(int x = 0; x < SIZE; ++x){
-                for(int y = 0; y < SIZE; ++y){
+            for(int x = 0; x < kSize; ++x){
+                for(int y = 0; y < kSize; ++y){
                     int z = XYtoZ(x, y);
                     if(color(z).any() && !color(z).filled()){ // edge positon
                         for(int d = 0; d < 4; ++d){
@@ -576,8 +628,8 @@ namespace Trax{
             }
 #ifdef USE_STRAIGHT
             // cell color - strait color
-            for(int x = 0; x < SIZE; ++x){
-                for(int y = 0; y < SIZE; ++y){
+            for(int x = 0; x < kSize; ++x){
+                for(int y = 0; y < kSize; ++y){
                     int z = XYtoZ(x, y);
                     if(color(z)[0] != straights_.get(0, x, y)){
                         cerr << "Board::exam() : cell color - straight color inconsistency" << endl;
@@ -608,11 +660,12 @@ namespace Trax{
         void clear()noexcept{
             turn = 0;
             hash = 0ULL;
-            bound.set(SIZE / 2, SIZE / 2);
+            symmetryHash.fill(0ULL);
+            bound.set(kSize / 2, kSize / 2);
             moveInfo.fill(MoveInfo(0));
             turnInfo.fill(TurnInfo(0));
             lines = 0;
-            line_.fill(LineInfo<SIZE>(0));
+            line_.fill(LineInfo<kSize>(0));
             cell_.fill(TileCell());
             edgeInfo_.fill(EdgeInfo(0));
             moves = 0;
@@ -620,7 +673,9 @@ namespace Trax{
             for(int c = 0; c < 2; ++c){
                 attackInfo[c].fill(AttackInfo());
             }
+#ifdef USE_STRAIGHT
             straights_.clear();
+#endif
             clearEvalInfo();
             
             lineShapeScore.fill(0);
@@ -641,9 +696,10 @@ namespace Trax{
         
         //template<class params_t>
         //void updateEvalInfo(const params_t& params){
-        void updateEvalInfo(){
+        void updateEvalInfo(EvalFeatures *const pfeatures = nullptr){
             // 評価のための諸々の情報を更新する
             // すでに試合終了していないことを前提とする
+            // pfeatures を渡した場合は特徴量の出現数も数える
             const Color myColor = turnColor();
             clearEvalInfo();
             for(int l0 = 0; l0 < lines; ++l0){
@@ -654,7 +710,10 @@ namespace Trax{
                 //frontShapeLines[c0][line(l0).frontShape()] += 1;
                 //lineShapes[c0][line(l0).shape()] += 1;
                 
-                lineShapeScore[myColor] += eval_params[4 + line(l0).shape() * 2 + int(myColor != c0)];
+                lineShapeScore[myColor] += evalParams[4 + line(l0).shape() * 2 + int(myColor != c0)];
+                if(pfeatures != nullptr){
+                    pfeatures->lineShape[c0][line(l0).shape()] += 1;
+                }
                 
                 int e0x = line(l0).x(0);
                 int e0y = line(l0).y(0);
@@ -705,11 +764,13 @@ namespace Trax{
                                            | (min(d[1][0][0], 3U) << 4)
                                            | (min(d[1][0][1], 3U) << 6)
                                            );
-                        twoLinesFrontShape[c0][l2pat0] += 1;
-                        twoLinesFrontShape[c0][l2pat1] += 1;
+                        if(pfeatures != nullptr){
+                            pfeatures->twoLinesFrontShape[c0][l2pat0] += 1;
+                            pfeatures->twoLinesFrontShape[c0][l2pat1] += 1;
+                        }
                         
-                        twoLinesFrontShapeScore[myColor] += eval_params[516 + l2pat0 * 2 + int(myColor != c0)];
-                        twoLinesFrontShapeScore[myColor] += eval_params[516 + l2pat1 * 2 + int(myColor != c0)];
+                        twoLinesFrontShapeScore[myColor] += evalParams[516 + l2pat0 * 2 + int(myColor != c0)];
+                        twoLinesFrontShapeScore[myColor] += evalParams[516 + l2pat1 * 2 + int(myColor != c0)];
                         
                         if(corner0 && line(l1).is11Corner()){
                             // 複数コーナー
@@ -984,8 +1045,7 @@ namespace Trax{
             const int x = ZtoX(z);
             const int y = ZtoY(z);
             if(!NO_OUT_BOARD){
-                if((x < MARGIN || SIZE - MARGIN <= x)
-                   || (y < MARGIN || SIZE - MARGIN <= y)){
+                if(!isOnBoard(x, y)){
                     return false; // 盤外
                 }
             }
@@ -1020,8 +1080,7 @@ namespace Trax{
             const int x = ZtoX(z);
             const int y = ZtoY(z);
             if(!NO_OUT_BOARD){
-                if((x < MARGIN || SIZE - MARGIN <= x)
-                   || (y < MARGIN || SIZE - MARGIN <= y)){
+                if(!isOnBoard(x, y)){
                     return false; // 盤外
                 }
             }
@@ -1118,7 +1177,8 @@ namespace Trax{
             const unsigned int x = ZtoX(z), y = ZtoY(z);
             setColor(z, nc);
             tile(z) = tl;
-            hash ^= tileHashTable[z][tl];
+            hash ^= tileHashKey(z, tl);
+            updateSymmetryHash<+1>(symmetryHash, x, y, tl);
             const int mi = pushMove(z, tl, last);
             // bound for victory line judge and reading notation
             // bound.update(x, y);
@@ -1182,6 +1242,9 @@ namespace Trax{
                         
                         edgeInfo(oxyd1).setLine(lnum, e0);
                         
+                        // lnum が最後の線の場合は下のスワップで番号が変わるので先に判定
+                        checkToSetVictoryLine(c, lnum, ret);
+                        
                         --lines;
                         
                         if(swappedlnum != lines){ // not last line
@@ -1198,8 +1261,6 @@ namespace Trax{
                             //moveInfo[mi].swappedLine[c] = 0; // line 0 can't swap
                         }
                         line(lines).clear();
-                        
-                        checkToSetVictoryLine(c, lnum, ret);
                     }
                 }else if(last.any(d0)){
                     unsigned int zd0 = z * 4 + d0;
@@ -1395,7 +1456,8 @@ namespace Trax{
                 }
             }
             popMove();
-            hash ^= tileHashTable[z][tl];
+            hash ^= tileHashKey(z, tl);
+            updateSymmetryHash<-1>(symmetryHash, ZtoX(z), ZtoY(z), tl);
             tile(z) = TILE_NONE;
             assignColor(z, last);
         }
@@ -1410,8 +1472,7 @@ namespace Trax{
             int x = ZtoX(z), y = ZtoY(z);
             // TODO: forcedで初めて盤外に出ることはないので pseudoLegality
             if(!kPseudoLegality){
-                if((x < MARGIN || SIZE - MARGIN <= x)
-                   || (y < MARGIN || SIZE - MARGIN <= y)){
+                if(!isOnBoard(x, y)){
                     return OUT_BOARD; // 盤外
                 }
             }
@@ -1470,7 +1531,10 @@ namespace Trax{
         }
         
         void pushAttack(Color c, int l, int type){
-            attackInfo[c][attacks[c]].set(l, type);
+            // 5つ目以降は情報を持たずに数だけ数える(後ろのメンバを書き潰さないように)
+            if(attacks[c] < int(attackInfo[c].size())){
+                attackInfo[c][attacks[c]].set(l, type);
+            }
             attacks[c] += 1;
         }
         
@@ -1690,12 +1754,27 @@ namespace Trax{
         }
     };
     
-    std::string toComparedString(const Board& bd0, const Board& bd1){
+    template<int kSize> constexpr int BoardT<kSize>::ar4[4];
+    template<int kSize> constexpr int BoardT<kSize>::Z_FIRST;
+    
+    using Board = BoardT<SIZE>; // 最大サイズの盤面
+    
+    // 盤面のサイズの目安
+    // SIZE = 128 で約 304KB (エッジ情報 256KB + マス情報 32KB + 手と線の履歴 16KB)
+    // 64 では約 88KB、32 では約 34KB
+    // スレッド数分持ち、同期やスナップショットでコピーもするので、これを超えないようにする
+    // 特徴量の数え上げ(EvalFeatures)や直線の色情報(USE_STRAIGHT)のような探索で使わないデータは盤面に持たない
+    static_assert(sizeof(Board) <= 320 * 1024, "Board should be kept under 320KB.");
+    static_assert(sizeof(BoardT<64>) <= 96 * 1024, "BoardT<64> should be kept under 96KB.");
+    
+    template<int kSize>
+    std::string toComparedString(const BoardT<kSize>& bd0, const BoardT<kSize>& bd1){
         return lineUp(bd0.toString(), bd1.toString(), 1);
     }
     
-    template<bool NO_FIRST_TURN = false, class move_t>
-    int generateMoves(move_t *const pmv0, const Board& bd){
+    template<bool NO_FIRST_TURN = false, class move_t, int kSize>
+    int generateMoves(move_t *const pmv0, const BoardT<kSize>& bd){
+        constexpr int Z_FIRST = BoardT<kSize>::Z_FIRST;
         // no forced-illegality check
         if(!NO_FIRST_TURN && bd.turn == 0){ // first move
             pmv0->set(Z_FIRST, PW);
@@ -1718,8 +1797,9 @@ namespace Trax{
         return pmv - pmv0;
     }
     
-    template<bool NO_FIRST_TURN = false, class move_t>
-    int generateNewerLineMoves(move_t *const pmv0, const Board& bd){
+    template<bool NO_FIRST_TURN = false, class move_t, int kSize>
+    int generateNewerLineMoves(move_t *const pmv0, const BoardT<kSize>& bd){
+        constexpr int Z_FIRST = BoardT<kSize>::Z_FIRST;
         // 線の新しい順に生成
         if(!NO_FIRST_TURN && bd.turn == 0){ // first move
             pmv0->set(Z_FIRST, PW);
@@ -1747,8 +1827,9 @@ namespace Trax{
         return pmv - pmv0;
     }
     
-    template<class move_t = Move, bool kRemoveIllegalMoves = false>
-    std::vector<move_t> generateMoveVector(Board& bd){
+    template<class move_t = Move, bool kRemoveIllegalMoves = false, int kSize>
+    std::vector<move_t> generateMoveVector(BoardT<kSize>& bd){
+        constexpr int Z_FIRST = BoardT<kSize>::Z_FIRST;
         std::vector<move_t> v;
         if(bd.turn == 0){ // first move
             v.push_back(move_t(Move(Z_FIRST, PW)));
@@ -1776,8 +1857,8 @@ namespace Trax{
         return v;
     }
     
-    template<class dice_t>
-    Move playRandomly(const Board& bd, dice_t *const pdice){
+    template<class board_t, class dice_t>
+    Move playRandomly(const board_t& bd, dice_t *const pdice){
         Move move[1024];
         int moves = generateMoves(move, bd);
         return move[pdice->rand() % moves];
@@ -0,0 +1,1280 @@
+/*
+ board8x8.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_BOARD8X8_HPP_
+#define TRAX_BOARD8X8_HPP_
+
+#include "trax.hpp"
+#include "board_elements.hpp"
+
+// 8x8 Trax 用のビットボード盤面表現
+// 8x8 Trax ではタイルの範囲が縦横 8 マスを超えられないので、
+// タイルの範囲の左上を原点にすれば、全てのタイルが 64 ビット整数 1 つに収まる
+// タイルと各方向の辺の色をビットボードで持ち、強制手の連鎖、ループとビクトリーラインの判定を
+// 色と方向ごとのビットボードのシフトとマスクでビット並列に行う
+// 着手生成やアタック判定で引くマスの色は、置いたタイルとその4近傍だけ書き換える表に持つ
+// 線は BoardT と同じ形式で差分更新し、アタックや評価の特徴も BoardT と同じものを求める
+
+namespace Trax{
+    
+    /**************************8x8 ビットボード**************************/
+    
+    // タイルの範囲の左上 (lx, ly) を原点として、(x, y) をビット (x - lx) * 8 + (y - ly) で表す
+    using BitBoard64 = uint64_t;
+    
+    constexpr BitBoard64 kFileFirst8x8 = 0x0101010101010101ULL; // y = ly の列
+    constexpr BitBoard64 kFileLast8x8  = 0x8080808080808080ULL; // y = ly + 7 の列
+    constexpr BitBoard64 kRankFirst8x8 = 0x00000000000000FFULL; // x = lx の行
+    constexpr BitBoard64 kRankLast8x8  = 0xFF00000000000000ULL; // x = lx + 7 の行
+    
+    template<int kDirection>
+    constexpr BitBoard64 shift8x8(BitBoard64 bb)noexcept{
+        // 全てのマスを方向 kDirection (ar4 と同じ順) の隣のマスへ動かす
+        // 8x8 の外に出たものは消える
+        return kDirection == 0 ? (bb >> 8)
+        : kDirection == 1 ? ((bb & ~kFileFirst8x8) >> 1)
+        : kDirection == 2 ? (bb << 8)
+        : ((bb & ~kFileLast8x8) << 1);
+    }
+    constexpr BitBoard64 neighbors8x8(BitBoard64 bb)noexcept{
+        // 4近傍
+        return shift8x8<0>(bb) | shift8x8<1>(bb) | shift8x8<2>(bb) | shift8x8<3>(bb);
+    }
+    
+    /**************************8x8 Trax 盤面表現**************************/
+    
+    class Board8x8{
+    public:
+        static constexpr int size()noexcept{ return 16; }
+        static constexpr int margin()noexcept{ return 0; }
+        static constexpr int WIDTH = 8; // タイルを置ける範囲の一辺
+        static constexpr int N_CELLS = 16 * 16;
+        static constexpr int N_MAX_TURNS = WIDTH * WIDTH; // 1手で少なくとも1枚置くので手数はマス数以下
+        static constexpr int N_MAX_LINES = N_MAX_TURNS * 2; // 線が新しく出来るのは1枚につき各色高々1本
+        
+        // 着手の座標系は BoardT と同じく z = x * size() + y
+        // 初手を中央に置くので、16x16 の範囲で全ての着手を表せる
+        static constexpr int ar4[4] = { -16, -1, +16, +1, };
+        static constexpr int ZtoX(unsigned int z)noexcept{ return z / 16; }
+        static constexpr int ZtoY(unsigned int z)noexcept{ return z % 16; }
+        static constexpr int XYtoZ(unsigned int x, unsigned int y)noexcept{ return x * 16 + y; }
+        static constexpr int Z_FIRST = 7 * 16 + 7;
+        static constexpr bool isOnBoard(int x, int y)noexcept{
+            return 0 <= x && x < 16 && 0 <= y && y < 16;
+        }
+        using XY = XYT<16>;
+        
+        // 線の端の座標系
+        // タイルは x, y = 0 ~ 14 に置かれるので、線の端のマスは 16x16 の外側(-1)にもはみ出す
+        // 線の端だけは x, y を 1 ずらした座標で持つ(18x18 あれば足りるが、割り算をシフトにするため 32x32 にする)
+        static constexpr int LINE_SIZE = 32;
+        static constexpr int N_LINE_ENDS = LINE_SIZE * LINE_SIZE * 4;
+        static constexpr int toLineZ(int x, int y)noexcept{ return (x + 1) * LINE_SIZE + (y + 1); }
+        static constexpr int LineZtoX(unsigned int lz)noexcept{ return int(lz / LINE_SIZE) - 1; }
+        static constexpr int LineZtoY(unsigned int lz)noexcept{ return int(lz % LINE_SIZE) - 1; }
+        static constexpr int lar4[4] = { -LINE_SIZE, -1, +LINE_SIZE, +1, };
+        static constexpr int lar8x8[4] = { -WIDTH, -1, +WIDTH, +1, }; // ビットボードのビット位置の差
+        
+        int turn; // 現在の手数
+        TileBound bound; // タイルの端の座標(ビットボードの原点でもある)
+        
+        uint64_t hash; // hash value
+        std::array<uint64_t, 8> symmetryHash; // 対称変換ごとのハッシュ値(絶対座標基準)
+        
+        int moves; // これまでに置かれたタイルの数
+        int lines; // 線の数
+        
+        // 以下評価のための情報(BoardT と同じ名前で持ち、TraxNode や探索部からそのまま使う)
+        std::array<int, 2> attacks; // アタックの数
+        std::array<std::array<AttackInfo, 4>, 2> attackInfo; // アタック情報
+        std::array<int, 2> threats;
+        std::array<int, 2> longLines; // ビクトリーラインを伺える線の数
+        std::array<int, 2> lineShapeScore;
+        std::array<int, 2> twoLinesFrontShapeScore;
+        
+        int modifiedLatestLineAge; // 変化させた最も新しい線の世代
+        
+        Color turnColor()const noexcept{ return toTurnColor(turn); }
+        Color lastTurnColor()const noexcept{ return flipColor(turnColor()); }
+        
+        // ノーテーション -> 座標に変換
+        int toBoardX(int nx)const noexcept{ return lx() - 1 + nx; }
+        int toBoardY(int ny)const noexcept{ return ly() - 1 + ny; }
+        int toBoardZ(int nx, int ny)const noexcept{
+            int x = toBoardX(nx), y = toBoardY(ny);
+            return isOnBoard(x, y) ? XYtoZ(x, y) : -1;
+        }
+        
+        // 座標 -> ノーテーションに変換
+        int toNotationX(int x)const noexcept{ return x - lx() + 1; }
+        int toNotationY(int y)const noexcept{ return y - ly() + 1; }
+        
+        // accessors
+        int dx()const noexcept{ return bound.dx(); }
+        int dy()const noexcept{ return bound.dy(); }
+        int lx()const noexcept{ return bound.lx(); }
+        int ly()const noexcept{ return bound.ly(); }
+        int hx()const noexcept{ return bound.hx(); }
+        int hy()const noexcept{ return bound.hy(); }
+        
+        BitBoard64 occupied()const noexcept{ return occupied_; }
+        BitBoard64 red(int d)const noexcept{ return red_[d]; }
+        const LineInfo<LINE_SIZE>& line(int l)const{ return line_[l]; }
+        
+        // 座標 <-> ビットボードのビット位置
+        bool inFrame(int x, int y)const noexcept{
+            return unsigned(x - lx()) < unsigned(WIDTH) && unsigned(y - ly()) < unsigned(WIDTH);
+        }
+        int toBit(int x, int y)const noexcept{ return (x - lx()) * WIDTH + (y - ly()); }
+        int bitToX(int b)const noexcept{ return lx() + b / WIDTH; }
+        int bitToY(int b)const noexcept{ return ly() + b % WIDTH; }
+        bool hasTile(int x, int y)const noexcept{
+            return inFrame(x, y) && ((occupied_ >> toBit(x, y)) & 1ULL);
+        }
+        
+        Tile tile(int z)const noexcept{
+            const int x = ZtoX(z), y = ZtoY(z);
+            return hasTile(x, y) ? tileAt(toBit(x, y)) : TILE_NONE;
+        }
+        TileColor color(int z)const noexcept{
+            return colorAt(ZtoX(z), ZtoY(z));
+        }
+        TileColor colorAt(int x, int y)const noexcept{
+            // タイルがあればその色、なければ隣から入ってくる線の色
+            // 線の端のマスは 16x16 の外側(x, y = -1)にもあるので、座標で受け取る
+            return TileColor(color_[toLineZ(x, y)]);
+        }
+        
+        Move pathMove(int t)const{
+            // ターン t の着手を得る
+            return history_[t].move;
+        }
+        std::vector<Move> getPath()const{
+            // これまでの着手列を得る
+            std::vector<Move> v;
+            for(int t = 0; t < turn; ++t){
+                v.emplace_back(pathMove(t));
+            }
+            return v;
+        }
+        
+        Tile whichTile(int z, TileMove tm)const{
+            // trax move notation (3 patterns) to tile (6 patterns)
+            if(z < 0 || z >= N_CELLS){ return TILE_NONE; }
+            for(int i = 0; i < 2; ++i){
+                Tile tile = toTile(tm, i);
+                if(isValidTile(z, tile)){ return tile; }
+            }
+            return TILE_NONE;
+        }
+        bool isValidTile(int z, Tile tile)const{
+            // only color connection
+            // isolation is OK in this method
+            return tileColorTable[tile].holds(color(z));
+        }
+        
+        bool isInWindow(int x, int y)const noexcept{
+            // (x, y) に置いてもタイルの範囲が 8x8 に収まるか
+            return max(hx(), x) - min(lx(), x) < WIDTH
+            && max(hy(), y) - min(ly(), y) < WIDTH;
+        }
+        bool isInWindow(int x0, int y0, int x1, int y1)const noexcept{
+            // 2マスの両方に置いてもタイルの範囲が 8x8 に収まるか
+            return max(hx(), max(x0, x1)) - min(lx(), min(x0, x1)) < WIDTH
+            && max(hy(), max(y0, y1)) - min(ly(), min(y0, y1)) < WIDTH;
+        }
+        
+        void enteringLines(std::array<BitBoard64, 4> *const pin,
+                           std::array<BitBoard64, 4> *const pred)const noexcept{
+            // 各マスに方向 d の隣のタイルから線が入ってくるか(pin)と、その線が赤か(pred)
+            // タイルについては、方向 d の隣にタイルがあるかを表す
+            (*pin)[0] = shift8x8<2>(occupied_); (*pred)[0] = shift8x8<2>(red_[2]);
+            (*pin)[1] = shift8x8<3>(occupied_); (*pred)[1] = shift8x8<3>(red_[3]);
+            (*pin)[2] = shift8x8<0>(occupied_); (*pred)[2] = shift8x8<0>(red_[0]);
+            (*pin)[3] = shift8x8<1>(occupied_); (*pred)[3] = shift8x8<1>(red_[1]);
+        }
+        
+        template<bool kPseudoLegality = false>
+        int makeMove(const Move& mv){
+            return makeMove<kPseudoLegality>(mv.z(), mv.tile());
+        }
+        template<bool kPseudoLegality = false>
+        int makeMove(int z, Tile tl){
+            // 8x8 に収まるかどうかは擬合法手でも判定する
+            if(z < 0 || z >= N_CELLS){ return OUT_BOARD; }
+            const int x = ZtoX(z), y = ZtoY(z);
+            if(turn > 0 && !isInWindow(x, y)){ return OUT_BOARD; }
+            if(!kPseudoLegality){
+                // 擬合法性が判定されていない場合は判定する
+                if(hasTile(x, y)){ return DOUBLE; } // 2重置き
+                TileColor last = color(z);
+                if(!tileColorTable[tl].holds(last)){ return BAD_COLOR; } // 色矛盾
+                if(!last.any() && turn != 0){ return ISOLATED; } // isolated move
+                if(turn == 0){
+                    if(z != Z_FIRST || (tl != PW && tl != SW)){
+                        return FIRST_RESTRICTION; // first move is restricted CW or PLW
+                    }
+                }
+            }
+            
+            // 元に戻すための状態保存
+            TurnState& st = history_[turn];
+            st.occupied = occupied_;
+            st.red = red_;
+            st.bound = bound;
+            st.hash = hash;
+            st.symmetryHash = symmetryHash;
+            st.moves = moves;
+            st.lines = lines;
+            st.attackLines = attackLines_;
+            st.edgeLogSize = edgeLogSize_;
+            st.lineLogSize = lineLogSize_;
+            st.colorLogSize = colorLogSize_;
+            st.move = Move(z, tl);
+            
+            // 原点が左上に動く場合はビットボードをずらす
+            // 範囲は 8x8 に収まるので、y 方向にずらしても行をまたぐビットはない
+            const int originShift = max(lx() - x, 0) * WIDTH + max(ly() - y, 0);
+            occupied_ <<= originShift;
+            for(BitBoard64& r : red_){ r <<= originShift; }
+            bound.update(x, y); // 境界はforcedでは変化しないのでここで良い
+            
+            const BitBoard64 before = occupied_;
+            int ret = put(toBit(x, y), tl);
+            if(ret < 0){ // illegal
+                unmakePlacedTiles(turn);
+                return ret;
+            }
+            const BitBoard64 placed = occupied_ & ~before;
+            ret = checkWins(placed);
+            
+            // 線の番号を BoardT と揃えるため、置いたタイルを BoardT::makeMoveSub と同じ順に線に繋いでいく
+            modifiedLatestLineAge = -1;
+            BitBoard64 pending = placed;
+            connectTile(toBit(x, y), &pending);
+            ++turn;
+            return ret;
+        }
+        
+        template<bool kTurnCheck = false>
+        void unmakeMove(int t){
+            // recover from change to turn |t|
+            if(kTurnCheck || (turn > t && t >= 0)){
+                unmakePlacedTiles(t);
+                turn = t;
+            }
+        }
+        template<bool kTurnCheck = false>
+        void unmakeMove(){
+            // recover from change on this turn
+            unmakeMove<kTurnCheck>(turn - 1);
+        }
+        
+        template<class board_t>
+        bool syncWith(const board_t& rhs){
+            // 盤面を rhs と同じ局面にする(BoardT::syncWith と同じく共通の手順は残す)
+            // 8x8 に収まらない着手があった場合はそこで止めて false を返す
+            constexpr int kOtherSize = board_t::size();
+            int t = 0;
+            const int tmax = min(turn, rhs.turn);
+            while(t < tmax && pathMove(t) == convertMove<kOtherSize, 16>(rhs.pathMove(t))){ ++t; }
+            unmakeMove(t);
+            for(; t < rhs.turn; ++t){
+                if(makeMove<true>(convertMove<kOtherSize, 16>(rhs.pathMove(t))) < 0){ return false; }
+            }
+            return true;
+        }
+        
+        bool isLegalMove(const Move& mv){
+            // 真の意味で合法がどうかの確認
+            int ret = makeMove(mv);
+            if(ret < 0){ return false; }
+            unmakeMove();
+            return true;
+        }
+        
+        template<
+        bool NO_OUT_BOARD = false,
+        bool NO_DOUBLE = false,
+        bool NO_BAD_COLOR = false,
+        bool NO_ISOLATED = false,
+        bool NO_FIRST_TURN = false>
+        bool isPseudoLegalMove(const Move& mv)const{
+            // とりあえずの合法性判定
+            // 連鎖ルールによって最終的に反則になる場合を考慮せず1個置けるかだけを考慮する
+            const int z = mv.z();
+            if(z < 0 || z >= N_CELLS){ return false; }
+            if(!NO_FIRST_TURN && turn == 0){
+                return z == Z_FIRST && !isBackTile(mv.tile());
+            }
+            if(!NO_OUT_BOARD){
+                if(!isInWindow(ZtoX(z), ZtoY(z))){
+                    return false; // 8x8 の外
+                }
+            }
+            if(!NO_DOUBLE && hasTile(ZtoX(z), ZtoY(z))){ return false; }
+            TileColor tc = color(z);
+            if(NO_ISOLATED || tc.any()){
+                if(tileColorTable[mv.tile()].holds(tc)){
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        void checkSetAttacks(){
+            // BoardT と同じく線の形からアタックを数える
+            // 8x8 の外に置かなければ完成しないものは数えない
+            // 線の幅はタイルの範囲 + 2 以下なので、範囲が狭いうちはビクトリーラインアタックを調べなくてよい
+            const bool victoryLineCandidate = max(dx(), dy()) + 2 >= VICTORY_LINE_LENGTH;
+            // アタックになりうる形の線は着手のたびに更新している集合から引くので、残りの線は見なくてよい
+            attacks.fill(0);
+            iterate(attackLines_, [this, victoryLineCandidate](int l)->void{
+                if(!line_[l].mate()){
+                    if(checkPushLoopAttack(l) <= 0 && victoryLineCandidate){
+                        checkPushSingleVictoryLineAttack(l);
+                    }
+                }
+            });
+        }
+        
+        bool hasInevasibleAttacks(const Color c)const{
+            // 複数のアタックがあり、回避不可能であるか
+            if(attacks[c] < 2){ return false; }
+            if(attacks[c] > 2){ return true; }
+            // 2つのループアタック同士が 1 turn connectable であれば1手で回避されてしまう
+            if(attackInfo[c][0].loop() && attackInfo[c][1].loop()){
+                for(int i = 0; i < 2; ++i){
+                    for(int j = 0; j < 2; ++j){
+                        if(check1TurnConnectable(line_[attackInfo[c][0].l].xy(i),
+                                                 line_[attackInfo[c][1].l].xy(j))){
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+        
+        void updateEvalInfo(EvalFeatures *const pfeatures = nullptr){
+            // 評価のための諸々の情報を更新する(BoardT::updateEvalInfo と同じ特徴)
+            // すでに試合終了していないことを前提とする
+            // pfeatures を渡した場合は特徴量の出現数も数える
+            const Color myColor = turnColor();
+            threats.fill(0);
+            longLines.fill(0);
+            lineShapeScore.fill(0);
+            twoLinesFrontShapeScore.fill(0);
+            // 2線関係は同じ色の線の組だけを見るので、線を色ごとに分け、端の座標を色ごとの配列に並べておく
+            // 1-1 コーナーの線はスレートを数えるために別に並べておく
+            std::array<LineEnds, 2> ends;
+            std::array<std::array<int, N_MAX_LINES>, 2> cornerLines;
+            std::array<int, 2> cornerLineCount = {0, 0};
+            ends[0].n = ends[1].n = 0;
+            for(int l0 = 0; l0 < lines; ++l0){
+                const LineInfo<LINE_SIZE>& line0 = line_[l0];
+                const Color c0 = line0.color();
+                
+                lineShapeScore[myColor] += evalParams[4 + line0.shape() * 2 + int(myColor != c0)];
+                if(pfeatures != nullptr){
+                    pfeatures->lineShape[c0][line0.shape()] += 1;
+                }
+                
+                // ビクトリーライン候補
+                if(max(VICTORY_LINE_LENGTH + 1 - line0.dx(), dx() - line0.dx()) <= 2){
+                    longLines[c0] += 1;
+                }
+                if(max(VICTORY_LINE_LENGTH + 1 - line0.dy(), dy() - line0.dy()) <= 2){
+                    longLines[c0] += 1;
+                }
+                
+                LineEnds& e = ends[c0];
+                e.x0[e.n] = line0.x(0); e.y0[e.n] = line0.y(0);
+                e.x1[e.n] = line0.x(1); e.y1[e.n] = line0.y(1);
+                e.n += 1;
+                if(line0.is11Corner()){
+                    cornerLines[c0][cornerLineCount[c0]++] = l0;
+                }
+            }
+            for(int ci = 0; ci < 2; ++ci){
+                const Color c0 = static_cast<Color>(ci);
+                const Color oc0 = flipColor(c0);
+                const int colorIndex = int(myColor != c0);
+                const LineEnds& e = ends[c0];
+                std::array<uint16_t, N_MAX_LINES> pattern0, pattern1;
+                int score = 0;
+                for(int i0 = 1; i0 < e.n; ++i0){
+                    // 2線関係(番号の小さい線との組のパターン番号をまとめて求めてから点数を足す)
+                    const int x0 = e.x0[i0], y0 = e.y0[i0], x1 = e.x1[i0], y1 = e.y1[i0];
+                    for(int i1 = 0; i1 < i0; ++i1){
+                        pattern0[i1] = (min(abs(x0 - e.x0[i1]), 3)
+                                        | (min(abs(y0 - e.y0[i1]), 3) << 2)
+                                        | (min(abs(x1 - e.x1[i1]), 3) << 4)
+                                        | (min(abs(y1 - e.y1[i1]), 3) << 6));
+                        pattern1[i1] = (min(abs(x0 - e.x1[i1]), 3)
+                                        | (min(abs(y0 - e.y1[i1]), 3) << 2)
+                                        | (min(abs(x1 - e.x0[i1]), 3) << 4)
+                                        | (min(abs(y1 - e.y0[i1]), 3) << 6));
+                    }
+                    for(int i1 = 0; i1 < i0; ++i1){
+                        score += evalParams[516 + pattern0[i1] * 2 + colorIndex];
+                        score += evalParams[516 + pattern1[i1] * 2 + colorIndex];
+                    }
+                    if(pfeatures != nullptr){
+                        for(int i1 = 0; i1 < i0; ++i1){
+                            pfeatures->twoLinesFrontShape[c0][pattern0[i1]] += 1;
+                            pfeatures->twoLinesFrontShape[c0][pattern1[i1]] += 1;
+                        }
+                    }
+                }
+                twoLinesFrontShapeScore[myColor] += score;
+                for(int i0 = 1; i0 < cornerLineCount[c0]; ++i0){
+                    for(int i1 = 0; i1 < i0; ++i1){
+                        threats[c0] += countCornerThreats(line_[cornerLines[c0][i0]], line_[cornerLines[c0][i1]], c0, oc0);
+                    }
+                }
+            }
+        }
+        
+        void clear()noexcept{
+            turn = 0;
+            hash = 0ULL;
+            symmetryHash.fill(0ULL);
+            bound.set(8, 8);
+            moves = 0;
+            lines = 0;
+            occupied_ = 0ULL;
+            red_.fill(0ULL);
+            color_.fill(0);
+            colorLogSize_ = 0;
+            line_.fill(LineInfo<LINE_SIZE>(0));
+            attackLines_.reset();
+            edge_.fill(0);
+            edgeLogSize_ = 0;
+            lineLogSize_ = 0;
+            attacks.fill(0);
+            for(int c = 0; c < 2; ++c){
+                attackInfo[c].fill(AttackInfo());
+            }
+            threats.fill(0);
+            longLines.fill(0);
+            lineShapeScore.fill(0);
+            twoLinesFrontShapeScore.fill(0);
+            modifiedLatestLineAge = -1;
+        }
+        
+        std::string toRawBoardString()const{
+            std::ostringstream oss;
+            oss << "  ";
+            for(int y = ly() - 1; y <= hy() + 1; ++y){
+                std::string cstr = toColumnString(toNotationY(y));
+                oss << " " << cstr << Space(max(0, 2 - int(cstr.size())));
+            }oss << endl;
+            for(int x = lx() - 1; x <= hx() + 1; ++x){
+                std::vector<Tile> tiles;
+                for(int y = ly() - 1; y <= hy() + 1; ++y){
+                    tiles.push_back(isOnBoard(x, y) ? tile(XYtoZ(x, y)) : TILE_NONE);
+                }
+                oss << drawTiles(tiles, toRowString(toNotationX(x)));
+            }
+            return oss.str();
+        }
+        std::string toInfoString()const{
+            std::ostringstream oss;
+            oss << "turn = " << turn << " tiles = " << moves << " lines = " << lines << endl;
+            int pat;
+            oss << "abs-key = " << hash << " rel-key = " << calcRepRelativeHash(*this, pat) << endl;
+            return oss.str();
+        }
+        std::string toString()const{
+            std::ostringstream oss;
+            oss << toInfoString();
+            oss << bound << endl;
+            oss << toRawBoardString();
+            return oss.str();
+        }
+        
+        template<int MODE = 0>
+        bool equals(const Board8x8& rhs)const{
+            auto differ = [](const char *const name)->bool{
+                if(MODE){
+                    cerr << "different |" << name << "|" << endl;
+                }
+                return false;
+            };
+            if(turn != rhs.turn){ return differ("turn"); }
+            if(moves != rhs.moves){ return differ("moves"); }
+            if(bound != rhs.bound){ return differ("bound"); }
+            if(hash != rhs.hash){ return differ("hash"); }
+            if(symmetryHash != rhs.symmetryHash){ return differ("symmetry hash"); }
+            if(occupied_ != rhs.occupied_){ return differ("occupied"); }
+            if(red_ != rhs.red_){ return differ("red"); }
+            if(lines != rhs.lines){ return differ("lines"); }
+            for(int l = 0; l < lines; ++l){
+                if(line_[l] != rhs.line_[l]){ return differ("line"); }
+            }
+            for(int t = 0; t < turn; ++t){
+                if(pathMove(t) != rhs.pathMove(t)){ return differ("path"); }
+            }
+            return true;
+        }
+        bool operator==(const Board8x8& rhs)const{
+            return equals(rhs);
+        }
+        bool operator!=(const Board8x8& rhs)const{
+            return !((*this) == rhs);
+        }
+        
+        bool exam(bool staticFlag = true)const{
+            // 盤面の整合性チェック
+            for(int d = 0; d < 4; ++d){
+                if(red_[d] & ~occupied_){
+                    cerr << "red end on an empty cell." << endl; return false;
+                }
+            }
+            // 各タイルの赤のエンドはちょうど2つ
+            BitBoard64 ones = 0ULL, twos = 0ULL, threes = 0ULL;
+            for(int d = 0; d < 4; ++d){
+                threes |= twos & red_[d];
+                twos |= ones & red_[d];
+                ones |= red_[d];
+            }
+            if(twos != occupied_ || threes){
+                cerr << "inconsistent tile." << endl; return false;
+            }
+            // 隣り合うタイルの色の一致
+            if(((occupied_ & shift8x8<2>(occupied_)) & (red_[0] ^ shift8x8<2>(red_[2])))
+               || ((occupied_ & shift8x8<3>(occupied_)) & (red_[1] ^ shift8x8<3>(red_[3])))){
+                cerr << "color mismatch between tiles." << endl; return false;
+            }
+            // 強制手が残っていない(8x8 の外のマスに接するタイルは1枚だけなので、8x8 の中だけ見ればよい)
+            std::array<BitBoard64, 4> in, inRed, inWhite;
+            enteringLines(&in, &inRed);
+            for(int d = 0; d < 4; ++d){
+                inWhite[d] = in[d] & ~inRed[d];
+            }
+            if((countTwoOrMore(inRed) | countTwoOrMore(inWhite)) & ~occupied_){
+                cerr << "forced move remains." << endl; return false;
+            }
+            // マスの色の表がタイルと入ってくる線に一致する
+            for(int x = lx() - 1; x <= lx() + WIDTH; ++x){
+                for(int y = ly() - 1; y <= ly() + WIDTH; ++y){
+                    unsigned int present = 0, red = 0;
+                    for(int d = 0; d < 4; ++d){
+                        const int tx = x + ar4_2d[d][0], ty = y + ar4_2d[d][1];
+                        if(hasTile(tx, ty)){
+                            present |= 1U << d;
+                            red |= unsigned((red_[oppositeDirection(d)] >> toBit(tx, ty)) & 1ULL) << d;
+                        }
+                    }
+                    const TileColor tc = hasTile(x, y) ? tileColorTable[tileAt(toBit(x, y))] : toTileColor(present, red);
+                    if(colorAt(x, y) != tc){
+                        cerr << "inconsistent color at (" << x << ", " << y << ")." << endl; return false;
+                    }
+                }
+            }
+            // 範囲と数
+            if(countBits64(occupied_) != moves){
+                cerr << "inconsistent number of tiles." << endl; return false;
+            }
+            if(moves > 0){
+                const BitBoard64 rows = (dx() >= WIDTH - 1) ? ~0ULL : ((1ULL << ((dx() + 1) * WIDTH)) - 1ULL);
+                const BitBoard64 files = kFileFirst8x8 * ((2ULL << dy()) - 1ULL);
+                if(dx() >= WIDTH || dy() >= WIDTH || (occupied_ & ~(rows & files))
+                   || !(occupied_ & kRankFirst8x8) || !(occupied_ & kFileFirst8x8)
+                   || !(occupied_ & (kRankFirst8x8 << (dx() * WIDTH))) || !(occupied_ & (kFileFirst8x8 << dy()))){
+                    cerr << "tiles out of bound " << bound << endl; return false;
+                }
+            }
+            // 線の端は空きマスにあり、端から線の番号が引けて、入ってくる線の色が一致する
+            // (ループが完成した線は端が埋まっている)
+            for(int l = 0; l < lines; ++l){
+                for(int e = 0; e < 2; ++e){
+                    const int lzd = line_[l].xyd(e);
+                    const int x = LineZtoX(lzd / 4), y = LineZtoY(lzd / 4);
+                    if(edge_[lzd] != l * 2 + e){
+                        cerr << "inconsistent line end of line " << l << "." << endl; return false;
+                    }
+                    const TileColor tc = colorAt(x, y);
+                    if((!line_[l].loop() && tc.filled()) || tc[lzd % 4] != (2 | line_[l].color())){
+                        cerr << "inconsistent line end color of line " << l << "." << endl; return false;
+                    }
+                }
+            }
+            // アタック候補の線の集合が線の形と一致する
+            for(int l = 0; l < N_MAX_LINES; ++l){
+                if(bool(attackLines_.test(l)) != (l < lines && isAttackLineShape(line_[l]))){
+                    cerr << "inconsistent attack line set at line " << l << "." << endl; return false;
+                }
+            }
+            uint64_t thash = 0ULL;
+            std::array<uint64_t, 8> tsymHash;
+            tsymHash.fill(0ULL);
+            iterate(BitSet64(occupied_), [this, &thash, &tsymHash](int b)->void{
+                const int x = bitToX(b), y = bitToY(b);
+                thash ^= tileHashKey(XYtoZ(x, y), tileAt(b));
+                updateSymmetryHash<+1>(tsymHash, x, y, tileAt(b));
+            });
+            if(thash != hash){
+                cerr << "inconsistent hash value." << endl; return false;
+            }
+            if(tsymHash != symmetryHash){
+                cerr << "inconsistent symmetry hash value." << endl; return false;
+            }
+            return true;
+        }
+        
+        template<class move_t>
+        int generateMovesSub(move_t *const pmv0)const{
+            // 初手以外の着手生成(BoardT と同じく座標の小さい順)
+            // タイルに隣接する空きマスのうち、8x8 の外にあるのは原点の上の行と左の列だけ
+            // そこに置けるのは範囲がまだ 8 に達していない場合だけで、入ってくる線は1本
+            const BitBoard64 inner = neighbors8x8(occupied_) & ~occupied_;
+            const BitBoard64 left = (dy() < WIDTH - 1) ? (occupied_ & kFileFirst8x8) : 0ULL;
+            move_t *pmv = pmv0;
+            if(dx() < WIDTH - 1){
+                iterate(BitSet64(occupied_ & kRankFirst8x8), [this, &pmv](int b)->void{
+                    const int y = bitToY(b);
+                    pmv = generateMovesAt(pmv, XYtoZ(lx() - 1, y), colorAt(lx() - 1, y));
+                });
+            }
+            for(int i = 0; i < WIDTH; ++i){
+                const int x = lx() + i;
+                if((left >> (i * WIDTH)) & 1ULL){
+                    pmv = generateMovesAt(pmv, XYtoZ(x, ly() - 1), colorAt(x, ly() - 1));
+                }
+                iterate(BitSet64((inner >> (i * WIDTH)) & kRankFirst8x8), [this, &pmv, i, x](int j)->void{
+                    pmv = generateMovesAt(pmv, XYtoZ(x, ly() + j), colorAt(x, ly() + j));
+                });
+            }
+            return pmv - pmv0;
+        }
+        template<class move_t>
+        int generateNewerLineMovesSub(move_t *const pmv0)const{
+            // 初手以外の着手を、BoardT と同じく番号の大きい線の端から順に生成
+            // 赤と白の線の端が同じマスにあることがあるので、生成済みのマスは飛ばす
+            // 置ける範囲(8x8 に収まり 16x16 の中)は先に求めておく
+            const int xl = max(hx() - (WIDTH - 1), 0), xh = min(lx() + (WIDTH - 1), 15);
+            const int yl = max(hy() - (WIDTH - 1), 0), yh = min(ly() + (WIDTH - 1), 15);
+            std::array<uint16_t, 16> done = {}; // 行ごとの生成済みのマス
+            move_t *pmv = pmv0;
+            for(int l = lines - 1; l >= 0; --l){
+                for(int e = 0; e < 2; ++e){
+                    const int lz = line_[l].xy(e);
+                    const int x = LineZtoX(lz), y = LineZtoY(lz);
+                    if(x < xl || x > xh || y < yl || y > yh){ continue; }
+                    if((done[x] >> y) & 1){ continue; }
+                    done[x] |= 1 << y;
+                    pmv = generateMovesAt(pmv, XYtoZ(x, y), colorAt(x, y));
+                }
+            }
+            return pmv - pmv0;
+        }
+    
+    protected:
+        struct TurnState{
+            // 1手戻すための状態
+            // タイル(ビットボード)とハッシュ値は丸ごと保存し、マスの色と線は書き換えの記録を巻き戻す
+            BitBoard64 occupied;
+            std::array<BitBoard64, 4> red;
+            TileBound bound;
+            uint64_t hash;
+            std::array<uint64_t, 8> symmetryHash;
+            int moves;
+            int lines;
+            LongBitSet<N_MAX_LINES> attackLines;
+            int colorLogSize, edgeLogSize, lineLogSize;
+            Move move;
+        };
+        struct LineLog{
+            int l;
+            LineInfo<LINE_SIZE> line;
+        };
+        struct LineEnds{
+            // updateEvalInfo で使う、ある色の線の端の座標(内側のループをベクトル化しやすいように座標ごとの配列にする)
+            std::array<int16_t, N_MAX_LINES> x0, y0, x1, y1;
+            int n;
+        };
+        
+        // 1枚置くごとの書き換えはマスの色が5つ、各色で線の端が高々3つ、線が高々2本
+        static constexpr int N_MAX_COLOR_LOGS = N_MAX_TURNS * 5;
+        static constexpr int N_MAX_EDGE_LOGS = N_MAX_TURNS * 2 * 3;
+        static constexpr int N_MAX_LINE_LOGS = N_MAX_TURNS * 2 * 2;
+        
+        BitBoard64 occupied_; // タイルのあるマス
+        std::array<BitBoard64, 4> red_; // 方向 d のエンドが赤のタイル
+        std::array<uint8_t, LINE_SIZE * LINE_SIZE> color_; // 線の座標系での各マスの TileColor(タイルがあればタイルの色)
+        std::array<LineInfo<LINE_SIZE>, N_MAX_LINES> line_; // 線(番号の付け方は BoardT と同じ)
+        LongBitSet<N_MAX_LINES> attackLines_; // アタックになりうる形の線の番号の集合
+        std::array<uint16_t, N_LINE_ENDS> edge_; // 線の端 -> 線の番号 * 2 + どちらの端か(開いている端でのみ有効)
+        std::array<uint32_t, N_MAX_EDGE_LOGS> edgeLog_; // edge_ の書き換え記録(位置 << 16 | 元の値)
+        std::array<LineLog, N_MAX_LINE_LOGS> lineLog_; // line_ の書き換え記録
+        std::array<uint32_t, N_MAX_COLOR_LOGS> colorLog_; // color_ の書き換え記録(位置 << 16 | 元の値)
+        int colorLogSize_, edgeLogSize_, lineLogSize_;
+        std::array<TurnState, N_MAX_TURNS + 1> history_;
+        
+        static constexpr Tile redEndsTileTable[16] = {
+            // 赤のエンドの方向のビット集合 -> タイル
+            TILE_NONE, TILE_NONE, TILE_NONE, SR,
+            TILE_NONE, PR, BW, TILE_NONE,
+            TILE_NONE, BR, PW, TILE_NONE,
+            SW, TILE_NONE, TILE_NONE, TILE_NONE,
+        };
+        
+        unsigned int redEnds(int b)const noexcept{
+            // ビット b のタイルの赤のエンドの方向のビット集合
+            return unsigned((red_[0] >> b) & 1ULL)
+            | (unsigned((red_[1] >> b) & 1ULL) << 1)
+            | (unsigned((red_[2] >> b) & 1ULL) << 2)
+            | (unsigned((red_[3] >> b) & 1ULL) << 3);
+        }
+        Tile tileAt(int b)const noexcept{
+            return redEndsTileTable[redEnds(b)];
+        }
+        
+        void paintColor(int lz, unsigned int red)noexcept{
+            // 赤のエンドが red のタイルの色と、4近傍のマスに入っていく線の色を表に書き込む
+            // 隣がタイルでも色は一致しているので、隣には OR で書き込んでよい
+            setColor(lz, tileColorTable[redEndsTileTable[red]].data());
+            for(int d = 0; d < 4; ++d){
+                const int tlz = lz + lar4[d];
+                setColor(tlz, color_[tlz] | ((2U | ((red >> d) & 1U)) << (2 * oppositeDirection(d))));
+            }
+        }
+        void setColor(int lz, unsigned int tc)noexcept{
+            colorLog_[colorLogSize_++] = (uint32_t(lz) << 16) | color_[lz];
+            color_[lz] = tc;
+        }
+        
+        static TileColor toTileColor(unsigned int present, unsigned int red)noexcept{
+            // 辺ごとの「線が入ってくるか」と「赤か」のビット集合から、辺ごとに 2 ビットの TileColor を作る
+            auto spread = [](unsigned int m)->unsigned int{
+                return (m & 1U) | ((m & 2U) << 1) | ((m & 4U) << 2) | ((m & 8U) << 3);
+            };
+            return TileColor(uint8_t((spread(present) << 1) | spread(red & present)));
+        }
+        static BitBoard64 countTwoOrMore(const std::array<BitBoard64, 4>& v)noexcept{
+            BitBoard64 ones = 0ULL, twos = 0ULL;
+            for(int d = 0; d < 4; ++d){
+                twos |= ones & v[d];
+                ones |= v[d];
+            }
+            return twos;
+        }
+        static void countTwoAndThree(const std::array<BitBoard64, 4>& v,
+                                     BitBoard64 *const ptwos, BitBoard64 *const pthrees)noexcept{
+            // 4方向のうち 2 つ以上、3 つ以上で立っているマス
+            BitBoard64 ones = 0ULL, twos = 0ULL, threes = 0ULL;
+            for(int d = 0; d < 4; ++d){
+                threes |= twos & v[d];
+                twos |= ones & v[d];
+                ones |= v[d];
+            }
+            *ptwos = twos;
+            *pthrees = threes;
+        }
+        
+        static BitBoard64 followLines(BitBoard64 bb, const std::array<BitBoard64, 4>& ends)noexcept{
+            // bb のタイルから、方向 d のエンドが ends[d] に含まれる辺を通って隣のマスへ進む
+            return shift8x8<0>(bb & ends[0]) | shift8x8<1>(bb & ends[1])
+            | shift8x8<2>(bb & ends[2]) | shift8x8<3>(bb & ends[3]);
+        }
+        void colorEnds(Color c, std::array<BitBoard64, 4> *const pends)const noexcept{
+            // 方向 d のエンドが色 c のタイル
+            for(int d = 0; d < 4; ++d){
+                (*pends)[d] = (c == RED) ? red_[d] : (occupied_ & ~red_[d]);
+            }
+        }
+        
+        template<class move_t>
+        static move_t *generateMovesAt(move_t *pmv, int z, TileColor tc){
+            // 入ってくる線の色から置けるタイルを表で引く
+            iterate(tileMoveBitTable[tc], [&pmv, z](int t)->void{
+                pmv->set(z, t);
+                ++pmv;
+            });
+            return pmv;
+        }
+        
+        void unmakePlacedTiles(int t)noexcept{
+            // ターン t の着手の前の状態に戻す
+            const TurnState& st = history_[t];
+            occupied_ = st.occupied;
+            red_ = st.red;
+            bound = st.bound;
+            hash = st.hash;
+            symmetryHash = st.symmetryHash;
+            moves = st.moves;
+            lines = st.lines;
+            attackLines_ = st.attackLines;
+            while(colorLogSize_ > st.colorLogSize){
+                const uint32_t log = colorLog_[--colorLogSize_];
+                color_[log >> 16] = log & 0xFF;
+            }
+            while(edgeLogSize_ > st.edgeLogSize){
+                const uint32_t log = edgeLog_[--edgeLogSize_];
+                edge_[log >> 16] = log & 0xFFFF;
+            }
+            while(lineLogSize_ > st.lineLogSize){
+                const LineLog& log = lineLog_[--lineLogSize_];
+                line_[log.l] = log.line;
+            }
+        }
+        
+        void setEdge(int lzd, int v)noexcept{
+            edgeLog_[edgeLogSize_++] = (uint32_t(lzd) << 16) | edge_[lzd];
+            edge_[lzd] = v;
+        }
+        LineInfo<LINE_SIZE>& modifyLine(int l)noexcept{
+            // 書き換える前の線を記録してから返す
+            lineLog_[lineLogSize_++] = LineLog{l, line_[l]};
+            return line_[l];
+        }
+        static bool isAttackLineShape(const LineInfo<LINE_SIZE>& line)noexcept{
+            // 端が直線上で2マス以内(ループアタック)か、ビクトリーラインに届く長さ
+            const int diff = abs(int(line.xy(1)) - int(line.xy(0)));
+            return diff == 1 || diff == LINE_SIZE || diff == 2 || diff == LINE_SIZE * 2
+            || int(line.dx()) >= VICTORY_LINE_LENGTH || int(line.dy()) >= VICTORY_LINE_LENGTH;
+        }
+        void updateAttackLine(int l)noexcept{
+            if(isAttackLineShape(line_[l])){
+                attackLines_.set(l);
+            }else{
+                attackLines_.reset(l);
+            }
+        }
+        
+        int put(int b, Tile tl)noexcept{
+            // タイルを置き、強制手をビット並列に置いていく
+            // 直前に置いたタイルに接する空きマスのうち、同じ色の線が2本入ってくるマスにはタイルが1つに決まる
+            // 同じ色の線が3本入ってくるマスがあるか、同時に決まったタイルどうしの色が合わなければ反則
+            // 強制手はタイルの範囲の中にしか置かれないので、8x8 の外は見なくてよい
+            BitBoard64 added = 1ULL << b;
+            occupied_ |= added;
+            for(int d = 0; d < 4; ++d){
+                red_[d] |= BitBoard64((tileColorBitsTable[tl].data() >> d) & 1U) << b;
+            }
+            while(true){
+                const BitBoard64 empty = neighbors8x8(added) & ~occupied_;
+                if(!empty){ return 0; }
+                std::array<BitBoard64, 4> in, inRed, inWhite;
+                enteringLines(&in, &inRed);
+                if(!(countTwoOrMore(in) & empty)){ return 0; } // 線が2本以上入ってくる空きマスがなければ強制手はない
+                for(int d = 0; d < 4; ++d){
+                    inWhite[d] = in[d] & ~inRed[d];
+                }
+                BitBoard64 red2, red3, white2, white3;
+                countTwoAndThree(inRed, &red2, &red3);
+                countTwoAndThree(inWhite, &white2, &white3);
+                if((red3 | white3) & empty){
+                    return FORCED_BAD_COLOR; // forcedによって色矛盾がおきた
+                }
+                red2 &= empty;
+                const BitBoard64 forced = red2 | (white2 & empty);
+                if(!forced){ return 0; }
+                // 赤が2本入ってくるマスはその2辺が赤、白が2本入ってくるマスは残りの2辺が赤
+                const BitBoard64 forcedByWhite = forced & ~red2;
+                for(int d = 0; d < 4; ++d){
+                    red_[d] |= (red2 & inRed[d]) | (forcedByWhite & ~inWhite[d]);
+                }
+                occupied_ |= forced;
+                if(((forced & shift8x8<2>(forced)) & (red_[0] ^ shift8x8<2>(red_[2])))
+                   || ((forced & shift8x8<3>(forced)) & (red_[1] ^ shift8x8<3>(red_[3])))){
+                    return FORCED_BAD_COLOR; // 同時に置いた強制手どうしの色矛盾
+                }
+                added = forced;
+            }
+        }
+        
+        int checkWins(BitBoard64 placed)const noexcept{
+            // 置いたタイルを通る線がループやビクトリーラインになったかを、色ごとに線に沿ってビット並列にたどって調べる
+            // 置いたタイルを1枚選び、その線を両方向に広げていき、調べ終わったタイルは候補から外す
+            // ループは隣が空いている辺(8x8 の外へ出る辺を含む)を持たない線
+            // ビクトリーラインは、タイルの範囲が 8 に達した方向で、一番端の行(列)から外へ出る辺を両端に持つ線
+            // 範囲の外には置けないので、ビクトリーラインが出来るのは範囲が 8 になっている方向だけ
+            // それ以外の空いている辺に届いた線はどちらでもないので、その時点で打ち切る
+            const bool vx = dx() >= VICTORY_LINE_LENGTH - 1, vy = dy() >= VICTORY_LINE_LENGTH - 1;
+            const std::array<BitBoard64, 4> exitable = {
+                vx ? kRankFirst8x8 : 0ULL, vy ? kFileFirst8x8 : 0ULL,
+                vx ? kRankLast8x8 : 0ULL, vy ? kFileLast8x8 : 0ULL,
+            };
+            // 辺の先にタイルがあるか(線の色はタイルのエンドで分かるので、入ってくる線の色は要らない)
+            const std::array<BitBoard64, 4> in = {
+                shift8x8<2>(occupied_), shift8x8<3>(occupied_), shift8x8<0>(occupied_), shift8x8<1>(occupied_),
+            };
+            int ret = 0;
+            for(int ci = 0; ci < 2; ++ci){
+                const Color c = static_cast<Color>(ci);
+                std::array<BitBoard64, 4> ends, open;
+                colorEnds(c, &ends);
+                BitBoard64 dead = 0ULL;
+                for(int d = 0; d < 4; ++d){
+                    open[d] = ends[d] & ~in[d];
+                    dead |= open[d] & ~exitable[d];
+                }
+                BitBoard64 candidates = placed & ~dead;
+                while(candidates){
+                    BitBoard64 visited = candidates & (0ULL - candidates);
+                    BitBoard64 frontier = visited;
+                    while(frontier && !(frontier & dead)){
+                        frontier = followLines(frontier, ends) & occupied_ & ~visited;
+                        visited |= frontier;
+                    }
+                    if(!frontier){
+                        if(!(visited & (open[0] | open[1] | open[2] | open[3]))){
+                            ret |= (Rule::LOOP << c);
+                        }else if((visited & open[0] & exitable[0] && visited & open[2] & exitable[2])
+                                 || (visited & open[1] & exitable[1] && visited & open[3] & exitable[3])){
+                            ret |= (Rule::VICTORY_LINE << c);
+                        }
+                    }
+                    candidates &= ~visited;
+                }
+            }
+            return ret;
+        }
+        
+        void connectTile(int b, BitBoard64 *const ppending){
+            // 置いたタイルを線に繋ぎ、4近傍で強制手になったタイルを深さ優先で繋いでいく
+            // マスの色はタイルを繋ぐときに塗るので、色の表で線が入ってくる辺は、隣のタイルがすでに繋がれた辺になる
+            // 強制手になるのは、同じ色の2辺ともの隣のタイルがすでに繋がれたとき
+            const int x = bitToX(b), y = bitToY(b);
+            const int lz = toLineZ(x, y);
+            const unsigned int red = redEnds(b);
+            const Tile tl = redEndsTileTable[red];
+            hash ^= tileHashKey(XYtoZ(x, y), tl);
+            updateSymmetryHash<+1>(symmetryHash, x, y, tl);
+            moves += 1;
+            const unsigned int last = TileColor(color_[lz]).tileBits().data();
+            paintColor(lz, red);
+            connectLines(x, y, tl, last);
+            *ppending &= ~(1ULL << b);
+            if(!*ppending){ return; } // 全て繋いだ
+            const BitBoard64 bit = 1ULL << b;
+            const std::array<BitBoard64, 4> next = {
+                shift8x8<0>(bit), shift8x8<1>(bit), shift8x8<2>(bit), shift8x8<3>(bit),
+            };
+            for(int d = 0; d < 4; ++d){
+                if(!(next[d] & *ppending)){ continue; }
+                const int tb = b + lar8x8[d];
+                const unsigned int sides = TileColor(color_[lz + lar4[d]]).tileBits().data();
+                const unsigned int tred = redEnds(tb);
+                if((sides & tred) == tred || (sides & ~tred & 15U) == (~tred & 15U)){
+                    connectTile(tb, ppending);
+                }
+            }
+        }
+        
+        void connectLines(int x, int y, Tile tl, unsigned int last){
+            // 置いたタイルの線を隣の線と繋ぐ(last は置く前に隣にタイルがあった方向のビット集合)
+            // 線の番号と端の順番は BoardT::move と同じ規則で決める
+            // 勝敗はビットボードで判定済みなので、ここでは線の情報だけを更新する
+            const int lz = toLineZ(x, y);
+            for(int ci = 0; ci < 2; ++ci){
+                const Color c = static_cast<Color>(ci);
+                const int d0 = tileConnectTable[tl][ci][0];
+                const int d1 = tileConnectTable[tl][ci][1];
+                const bool any0 = (last >> d0) & 1U, any1 = (last >> d1) & 1U;
+                if(any0 && any1){
+                    const int l0 = edge_[lz * 4 + d0] >> 1, e0 = edge_[lz * 4 + d0] & 1;
+                    const int l1 = edge_[lz * 4 + d1] >> 1, e1 = edge_[lz * 4 + d1] & 1;
+                    if(l0 == l1){ // ループ
+                        modifyLine(l0).setLoop();
+                        continue;
+                    }
+                    // 線 l0 の端を線 l1 の反対側の端に付け替え、線 l1 は最後の線で埋める
+                    const int oxyd1 = line_[l1].xyd(1 - e1);
+                    modifiedLatestLineAge = max(modifiedLatestLineAge, int(max(line_[l0].age(), line_[l1].age())));
+                    LineInfo<LINE_SIZE>& line0 = modifyLine(l0);
+                    line0.assignEnd(e0, oxyd1);
+                    line0.assignAge(turn);
+                    line0.setShape();
+                    setEdge(oxyd1, l0 * 2 + e0);
+                    markVictoryLine(line0);
+                    updateAttackLine(l0);
+                    --lines;
+                    if(l1 != lines){
+                        for(int e = 0; e < 2; ++e){
+                            setEdge(line_[lines].xyd(e), l1 * 2 + e);
+                        }
+                        modifyLine(l1) = line_[lines];
+                        updateAttackLine(l1);
+                    }
+                    attackLines_.reset(lines);
+                }else if(any0 || any1){
+                    // 線を延ばす
+                    const int din = any0 ? d0 : d1;
+                    const int dout = d0 + d1 - din;
+                    const int l = edge_[lz * 4 + din] >> 1, e = edge_[lz * 4 + din] & 1;
+                    const int tzd = toLineZ(x + ar4_2d[dout][0], y + ar4_2d[dout][1]) * 4 + oppositeDirection(dout);
+                    modifiedLatestLineAge = max(modifiedLatestLineAge, int(line_[l].age()));
+                    LineInfo<LINE_SIZE>& line = modifyLine(l);
+                    line.assignEnd(e, tzd);
+                    line.assignAge(turn);
+                    line.setShape();
+                    setEdge(tzd, l * 2 + e);
+                    markVictoryLine(line);
+                    updateAttackLine(l);
+                }else{
+                    // 新しい線(端の番号が小さい方を 0 番目の端にする)
+                    const int tzd0 = toLineZ(x + ar4_2d[d0][0], y + ar4_2d[d0][1]) * 4 + oppositeDirection(d0);
+                    const int tzd1 = toLineZ(x + ar4_2d[d1][0], y + ar4_2d[d1][1]) * 4 + oppositeDirection(d1);
+                    const int l = lines++;
+                    LineInfo<LINE_SIZE>& line = modifyLine(l); // 同じ手で繋いで空いた番号を使う場合があるので記録する
+                    line = LineInfo<LINE_SIZE>(0);
+                    line.setColor(c);
+                    line.assignEnd(0, min(tzd0, tzd1));
+                    line.assignEnd(1, max(tzd0, tzd1));
+                    line.assignAge(turn);
+                    line.setShape();
+                    setEdge(min(tzd0, tzd1), l * 2 + 0);
+                    setEdge(max(tzd0, tzd1), l * 2 + 1);
+                    updateAttackLine(l);
+                }
+            }
+        }
+        
+        void markVictoryLine(LineInfo<LINE_SIZE>& line)const noexcept{
+            // 勝敗はビットボードで判定済みなので、BoardT と同じく線に印を付けるだけ
+            // 強制手で範囲の外にタイルが置かれることはないので、線を繋ぐたびに判定してよい
+            if((dx() >= VICTORY_LINE_LENGTH - 1 && int(line.dx()) >= dx() + 2)
+               || (dy() >= VICTORY_LINE_LENGTH - 1 && int(line.dy()) >= dy() + 2)){
+                line.setVictoryLine();
+            }
+        }
+        
+        void pushAttack(Color c, int l, int type){
+            // 5つ目以降は情報を持たずに数だけ数える
+            if(attacks[c] < int(attackInfo[c].size())){
+                attackInfo[c][attacks[c]].set(l, type);
+            }
+            attacks[c] += 1;
+        }
+        
+        int check1TurnConnectable(const unsigned int lz0,
+                                  const unsigned int lz1)const{
+            // 1手で接続可能な2点エッジかどうかチェックする(線の端の座標で受け取る)
+            // 接続に使うマスは2点を含む長方形の中にあるので、2点が 8x8 に収まらなければ接続できない
+            const int x0 = LineZtoX(lz0), y0 = LineZtoY(lz0);
+            const int x1 = LineZtoX(lz1), y1 = LineZtoY(lz1);
+            const int adx = abs(x1 - x0), ady = abs(y1 - y0);
+            if(adx + ady > 2 || !isInWindow(x0, y0, x1, y1)){
+                return 0;
+            }
+            if(adx + ady == 1){ // 確実に2マスconnectable
+                return 2;
+            }
+            if(adx + ady == 2){ // ３マスconnectableの可能性
+                if(!(adx & 1)){ // 直線型
+                    const TileColor tc = colorAt((x0 + x1) / 2, (y0 + y1) / 2);
+                    if(!tc.filled() && tc.any()){
+                        return 3;
+                    }
+                }else{ // カド型
+                    TileColor tc = colorAt(x0, y1);
+                    if(!tc.filled() && tc.any()){
+                        return 3;
+                    }
+                    tc = colorAt(x1, y0);
+                    if(!tc.filled() && tc.any()){
+                        return 3;
+                    }
+                }
+            }
+            return 0;
+        }
+        
+        bool canPlaceEndForcedTile(unsigned int lz, TileColor tc0)const{
+            // 線の端のマスに tc0 のタイルを 8x8 に収めて置けるか
+            const int x = LineZtoX(lz), y = LineZtoY(lz);
+            return tc0.holds(colorAt(x, y)) && isInWindow(x, y);
+        }
+        bool checkSingleVictoryLineAttackSubX(const Color c, const int l, int e0 , int e1){
+            const LineInfo<LINE_SIZE>& line = line_[l];
+            if(LineZtoX(line.xy(e0)) + 1 == lx()
+               && canPlaceEndForcedTile(line.xy(e1), endForcedTileColorTable[c][line.d(e1)][2])){
+                return true;
+            }
+            if(LineZtoX(line.xy(e1)) - 1 == hx()
+               && canPlaceEndForcedTile(line.xy(e0), endForcedTileColorTable[c][line.d(e0)][0])){
+                return true;
+            }
+            return false;
+        }
+        bool checkSingleVictoryLineAttackSubY(const Color c, const int l, int e0 , int e1){
+            const LineInfo<LINE_SIZE>& line = line_[l];
+            if(LineZtoY(line.xy(e0)) + 1 == ly()
+               && canPlaceEndForcedTile(line.xy(e1), endForcedTileColorTable[c][line.d(e1)][3])){
+                return true;
+            }
+            if(LineZtoY(line.xy(e1)) - 1 == hy()
+               && canPlaceEndForcedTile(line.xy(e0), endForcedTileColorTable[c][line.d(e0)][1])){
+                return true;
+            }
+            return false;
+        }
+        
+        int checkPushSingleVictoryLineAttack(const int l){
+            // 単体のビクトリーラインアタックであるか判定する
+            const LineInfo<LINE_SIZE>& line = line_[l];
+            const Color c = line.color();
+            const int ldx = line.dx();
+            if(ldx >= VICTORY_LINE_LENGTH){ // 長さ VICTORY_LINE_LENGTH - 1 以上
+                const int x0 = LineZtoX(line.xy(0)), y0 = LineZtoY(line.xy(0));
+                const int x1 = LineZtoX(line.xy(1)), y1 = LineZtoY(line.xy(1));
+                if(ldx == dx() + 2){ // どちらかの端に置ければライン完成
+                    if(isInWindow(x0, y0) || isInWindow(x1, y1)){
+                        pushAttack(c, l, VICTORY_LINE_LENGTH - 1);
+                        return VICTORY_LINE_LENGTH - 1;
+                    }
+                }else if(ldx == dx() + 1){ // 1つ置ければライン完成
+                    if(x0 < x1 ? checkSingleVictoryLineAttackSubX(c, l, 0, 1)
+                       : checkSingleVictoryLineAttackSubX(c, l, 1, 0)){
+                        pushAttack(c, l, VICTORY_LINE_LENGTH - 1);
+                        return VICTORY_LINE_LENGTH - 1;
+                    }
+                }
+            }
+            const int ldy = line.dy();
+            if(ldy >= VICTORY_LINE_LENGTH){ // 長さ VICTORY_LINE_LENGTH - 1 以上
+                const int x0 = LineZtoX(line.xy(0)), y0 = LineZtoY(line.xy(0));
+                const int x1 = LineZtoX(line.xy(1)), y1 = LineZtoY(line.xy(1));
+                if(ldy == dy() + 2){ // どちらかの端に置ければライン完成
+                    if(isInWindow(x0, y0) || isInWindow(x1, y1)){
+                        pushAttack(c, l, VICTORY_LINE_LENGTH - 1);
+                        return VICTORY_LINE_LENGTH - 1;
+                    }
+                }else if(ldy == dy() + 1){ // 1つ置ければライン完成
+                    if(y0 < y1 ? checkSingleVictoryLineAttackSubY(c, l, 0, 1)
+                       : checkSingleVictoryLineAttackSubY(c, l, 1, 0)){
+                        pushAttack(c, l, VICTORY_LINE_LENGTH - 1);
+                        return VICTORY_LINE_LENGTH - 1;
+                    }
+                }
+            }
+            return -1;
+        }
+        
+        int checkPushLoopAttack(const int l){
+            // ループアタックかどうか判定し追加する
+            // ループを閉じるタイルは両端を含む長方形の中に置かれるので、両端が 8x8 に収まるものだけ数える
+            // タイルの範囲は 8x8 なので線の端が行をまたぐことはなく、端の位置関係は座標の差だけで分かる
+            const LineInfo<LINE_SIZE>& line = line_[l];
+            const int lz0 = line.xy(0), lz1 = line.xy(1);
+            const int diff = abs(lz1 - lz0);
+            if(diff != 1 && diff != LINE_SIZE && diff != 2 && diff != LINE_SIZE * 2){
+                return -1; // ループアタックではない(カド型を含む)
+            }
+            if(!isInWindow(LineZtoX(lz0), LineZtoY(lz0), LineZtoX(lz1), LineZtoY(lz1))){ return -1; }
+            const Color c = line.color();
+            if(diff == 1 || diff == LINE_SIZE){ // 確実に2マスアタック
+                pushAttack(c, l, 2);
+                return 2;
+            }
+            // 直線型の３マスアタック(カド型は BoardT でも数えていないので、評価を揃えるため数えない)
+            const int lzm = (lz0 + lz1) / 2;
+            const TileColor tc = colorAt(LineZtoX(lzm), LineZtoY(lzm));
+            if(!tc.filled() && tc.any()){
+                pushAttack(c, l, 3);
+                return 3;
+            }
+            return -1;
+        }
+        
+        int countCornerThreats(const LineInfo<LINE_SIZE>& line0, const LineInfo<LINE_SIZE>& line1,
+                               const Color c0, const Color oc0)const{
+            // 1-1 コーナー同士の位置関係からスレートを数える(BoardT::updateEvalInfo と同じパターン)
+            // コーナーのタイルの座標
+            const int x0 = line0.bx(0) - 1, y0 = line0.by(0) - 1;
+            const int x1 = line1.bx(0) - 1, y1 = line1.by(0) - 1;
+            const Tile t0 = tile(XYtoZ(x0, y0));
+            const Tile t1 = tile(XYtoZ(x1, y1));
+            
+            // コーナーの位置が桂馬で、タイルが同じ向きであれば高確率でL字スレート
+            if(t0 == t1 && abs((x0 - x1) * (y0 - y1)) == 2){
+                return 1;
+            }
+            // コーナーの位置が2個離れで、間が二つとも逆の色(ただし同じ線でない)ならエッジスレート
+            auto gapOpen = [this, oc0](int ax0, int ay0, int ax1, int ay1, int d)->bool{
+                const TileColor tc0 = colorAt(ax0, ay0), tc1 = colorAt(ax1, ay1);
+                return (!tc0.filled() && tc0[d] == (oc0 | 2))
+                && (!tc1.filled() && tc1[d] == (oc0 | 2));
+            };
+            if(x0 == x1 && abs(y1 - y0) == 3){
+                const int aiy0 = (y0 + y1 - 1) / 2;
+                const int aiy1 = (y0 + y1 + 1) / 2;
+                if((t0 == toTile(S, c0) && t1 == toTile(B, c0))
+                   || (t1 == toTile(S, c0) && t0 == toTile(B, c0))){ // 上向き
+                    return int(gapOpen(x0 - 1, aiy0, x0 - 1, aiy1, 2));
+                }
+                if((t0 == toTile(S, oc0) && t1 == toTile(B, oc0))
+                   || (t1 == toTile(S, oc0) && t0 == toTile(B, oc0))){ // 下向き
+                    return int(gapOpen(x0 + 1, aiy0, x0 + 1, aiy1, 0));
+                }
+            }else if(y0 == y1 && abs(x1 - x0) == 3){
+                const int aix0 = (x0 + x1 - 1) / 2;
+                const int aix1 = (x0 + x1 + 1) / 2;
+                if((t0 == toTile(S, c0) && t1 == toTile(B, oc0))
+                   || (t1 == toTile(S, c0) && t0 == toTile(B, oc0))){ // 左向き
+                    return int(gapOpen(aix0, y0 - 1, aix1, y0 - 1, 3));
+                }
+                if((t0 == toTile(S, oc0) && t1 == toTile(B, c0))
+                   || (t1 == toTile(S, oc0) && t0 == toTile(B, c0))){ // 右向き
+                    return int(gapOpen(aix0, y0 + 1, aix1, y0 + 1, 1));
+                }
+            }
+            return 0;
+        }
+    };
+    
+    constexpr int Board8x8::ar4[4];
+    constexpr int Board8x8::lar4[4];
+    constexpr int Board8x8::lar8x8[4];
+    constexpr int Board8x8::Z_FIRST;
+    constexpr Tile Board8x8::redEndsTileTable[16];
+    
+    // 全手数分の状態保存と線の書き換え記録を含めても BoardT よりずっと小さいので、スレッドごとに持ってコピーしても問題ない
+    static_assert(sizeof(Board8x8) <= 32 * 1024, "Board8x8 should be kept under 32KB.");
+    
+    template<bool NO_FIRST_TURN = false, class move_t>
+    int generateMoves(move_t *const pmv0, const Board8x8& bd){
+        if(!NO_FIRST_TURN && bd.turn == 0){ // first move
+            pmv0->set(Board8x8::Z_FIRST, PW);
+            (pmv0 + 1)->set(Board8x8::Z_FIRST, SW);
+            return 2;
+        }
+        return bd.generateMovesSub(pmv0);
+    }
+    
+    template<bool NO_FIRST_TURN = false, class move_t>
+    int generateNewerLineMoves(move_t *const pmv0, const Board8x8& bd){
+        // 線の新しい順に生成
+        if(!NO_FIRST_TURN && bd.turn == 0){ // first move
+            pmv0->set(Board8x8::Z_FIRST, PW);
+            (pmv0 + 1)->set(Board8x8::Z_FIRST, SW);
+            return 2;
+        }
+        return bd.generateNewerLineMovesSub(pmv0);
+    }
+    
+    template<class move_t = Move, bool kRemoveIllegalMoves = false>
+    std::vector<move_t> generateMoveVector(Board8x8& bd){
+        std::vector<move_t> v;
+        std::array<Move, Board8x8::N_CELLS> buffer;
+        const int n = generateMoves(buffer.data(), bd);
+        for(int m = 0; m < n; ++m){
+            if(kRemoveIllegalMoves){
+                if(bd.isLegalMove(buffer[m])){
+                    v.push_back(move_t(buffer[m]));
+                }
+            }else{
+                v.push_back(move_t(buffer[m]));
+            }
+        }
+        return v;
+    }
+}
+
+#endif // TRAX_BOARD8X8_HPP_
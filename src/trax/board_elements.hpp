@@ -66,12 +66,11 @@ namespace Trax{
     /**************************エッジの情報**************************/
     
     struct EdgeInfo{
+        // 盤面ごとに SIZE * SIZE * 4 個持つので、パディング無しの4バイトに詰める
         //LineRef lRef; // このエッジを端点とする線の情報
-        short lineIndex_; // 線のインデックス
+        uint16_t lineIndex_; // 線のインデックス
         uint8_t lineEnd_; // 線のどちらの端点か
         uint8_t age_; // このエッジが出来たターン
-        int last_, next_; // 前と次のエッジインデックス
-        EdgeConnection connection_; // 次のエッジとの接続関係
         
     public:
         int lineIndex()const noexcept{
@@ -80,19 +79,9 @@ namespace Trax{
         uint8_t lineEnd()const noexcept{
             return lineEnd_;
         }
-        EdgeConnection connection()const noexcept{
-            return connection_;
-        }
         uint8_t age()const noexcept{
             return age_;
         }
-        int last()const noexcept{
-            return last_;
-        }
-        int next()const noexcept{
-            return next_;
-        }
-        
         
         void setLine(unsigned int l, unsigned int e){
             setLineIndex(l);
@@ -108,29 +97,18 @@ namespace Trax{
             lineIndex_ = 0;
             lineEnd_ = 0;
         }
-        void setLast(int le)noexcept{
-            last_ = le;
-        }
-        void setNext(int ne)noexcept{
-            next_ = ne;
-        }
         void setAge(uint8_t a)noexcept{
             age_ = a;
         }
-        void setConnection(EdgeConnection c)noexcept{
-            connection_ = c;
-        }
         
         void clear(){
             lineIndex_ = 0;
             lineEnd_ = 0;
             age_ = 0;
-            last_ = next_ = 0;
-            connection_ = EDGECONNECTION_NONE;
         }
         
         bool operator==(const EdgeInfo& rhs)const noexcept{
-            return lineIndex() == rhs.lineIndex() || lineEnd()== rhs.lineEnd();
+            return lineIndex() == rhs.lineIndex() && lineEnd()== rhs.lineEnd();
         }
         bool operator!=(const EdgeInfo& rhs)const noexcept{
             return !((*this) == rhs);
@@ -144,9 +122,7 @@ namespace Trax{
         
         EdgeInfo(){}
         EdgeInfo(int v):
-        lineIndex_(0), lineEnd_(0),
-        age_(0), last_(0), next_(0),
-        connection_(EDGECONNECTION_NONE){}
+        lineIndex_(0), lineEnd_(0), age_(0){}
         
         //EdgeInfo(unsigned int al, unsigned int ae):
         //v(std::make_tuple(al, ae)){}
@@ -159,6 +135,8 @@ namespace Trax{
          }*/
     };
     
+    static_assert(sizeof(EdgeInfo) == 4, "EdgeInfo should be packed into 4 bytes.");
+    
     std::ostream& operator<<(std::ostream& ost, const EdgeInfo& ei){
         ost << ei.toString();
         return ost;
@@ -388,7 +366,7 @@ namespace Trax{
     struct MoveInfo{
         // タイルを1つ置くときに保存するデータ
         // 不可逆的に変化する盤面情報を保存しておく必要がある
-        int z; // 置いた座標
+        uint16_t z; // 置いた座標
         TileColor last; // 置いたマスの元々のTileColor
         Tile tile; // 新しいマスのTileColor
         std::array<std::array<uint8_t, 2>, 2> lineAge; // 更新された線の元の世代(不可逆変化のためここに記録)
@@ -416,6 +394,8 @@ namespace Trax{
         }
     };
     
+    static_assert(SIZE * SIZE <= 65536, "MoveInfo::z should hold a cell index.");
+    
     std::ostream& operator<<(std::ostream& ost, const MoveInfo& mi){
         ost << mi.toString();
         return ost;
@@ -506,6 +486,20 @@ namespace Trax{
         l(-1), type(0){}
     };
     
+    struct EvalFeatures{
+        // 評価関数の特徴量の出現数
+        // 学習や解析のときだけ数えるので盤面とは別に持つ(探索中は数えない)
+        std::array<std::array<int, 256>, 2> lineShape; // 線割
+        std::array<std::array<int, 16 * 16>, 2> twoLinesFrontShape; // 2線関係
+        
+        void clear()noexcept{
+            for(int c = 0; c < 2; ++c){
+                lineShape[c].fill(0);
+                twoLinesFrontShape[c].fill(0);
+            }
+        }
+    };
+    
     /*struct ThreatInfo{
      int type; // 種類
      void set(int al, int atype)noexcept{
@@ -662,6 +656,10 @@ namespace Trax{
         // y軸方向が0, x軸方向が1
         std::array<std::array<Straight<N>, N + 1>, 2> st_;
         
+        // z は幅 N の盤面上の座標(大域の ZtoX, ZtoY は SIZE 幅なので使わない)
+        static constexpr int ZtoX(unsigned int z)noexcept{ return z / N; }
+        static constexpr int ZtoY(unsigned int z)noexcept{ return z % N; }
+        
         void clear(){
             for(int i = 0; i < 2; ++i){
                 for(int j = 0; j < N + 1; ++j){
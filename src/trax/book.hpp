@@ -0,0 +1,211 @@
+/*
+ book.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_BOOK_HPP_
+#define TRAX_BOOK_HPP_
+
+#include <map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************定跡**************************/
+    
+    // 定跡ファイルの形式(リトルエンディアン)
+    //   BookHeader
+    //   BookEntry * entries (キーの昇順)
+    //   BookMove  * moves   (各エントリの候補手が連続して並ぶ)
+    // キーは calcRepRelativeHash() の代表ハッシュ値
+    // 候補手は置換表と同じく代表の対称型での相対座標で持つので、引く時は fromSymmetryMove() で戻すだけでよい
+    
+    struct BookHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t entries;
+        uint32_t moves;
+        uint32_t reserved;
+    };
+    
+    struct BookEntry{
+        uint64_t key;
+        uint32_t firstMove;
+        uint16_t moves;
+        uint16_t reserved;
+    };
+    
+    struct BookMove{
+        uint8_t x, y; // 代表の対称型での相対座標
+        int8_t tile;
+        uint8_t depth; // 評価した探索の深さ(手数)
+        int16_t score; // 局面の手番側から見た点
+        uint16_t count; // 生成時に出現した回数
+        
+        Move symmetryMove()const noexcept{
+            return Move(SYMMETRY_MOVE_FLAG | (uint32_t(x) << 8) | y, static_cast<uint8_t>(tile));
+        }
+        
+        BookMove() = default;
+        BookMove(const Move& smv, int ascore, int adepth, int acount = 0):
+        x((smv.z() >> 8) & 255), y(smv.z() & 255), tile(smv.tile()),
+        depth(static_cast<uint8_t>(max(0, min(adepth, 255)))),
+        score(static_cast<int16_t>(ascore)),
+        count(static_cast<uint16_t>(max(0, min(acount, 65535)))){}
+    };
+    
+    static_assert(sizeof(BookHeader) == 24, "");
+    static_assert(sizeof(BookEntry) == 16, "");
+    static_assert(sizeof(BookMove) == 8, "");
+    
+    class Book{
+    public:
+        static constexpr char kMagic[8] = {'K', 'Z', 'N', 'B', 'O', 'O', 'K', '\0'};
+        static constexpr uint32_t kVersion = 1;
+        
+        bool open(const std::string& path){
+            // 定跡ファイルをメモリにマップする
+            close();
+#ifdef _WIN32
+            std::ifstream ifs(path, std::ios::binary);
+            if(!ifs){ return false; }
+            buffer_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+            const char *const p = buffer_.data();
+            const size_t size = buffer_.size();
+#else
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){ return false; }
+            struct stat st;
+            if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(BookHeader)){
+                ::close(fd); return false;
+            }
+            void *const m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd); // マップした後は閉じてよい
+            if(m == MAP_FAILED){ return false; }
+            map_ = m;
+            mapSize_ = st.st_size;
+            const char *const p = static_cast<const char*>(m);
+            const size_t size = mapSize_;
+#endif
+            if(size < sizeof(BookHeader)){ close(); return false; }
+            const BookHeader *const header = reinterpret_cast<const BookHeader*>(p);
+            if(memcmp(header->magic, kMagic, sizeof(kMagic)) || header->version != kVersion
+               || size != sizeof(BookHeader) + header->entries * sizeof(BookEntry) + header->moves * sizeof(BookMove)){
+                cerr << "Book::open() : broken book file " << path << endl;
+                close(); return false;
+            }
+            entries_ = reinterpret_cast<const BookEntry*>(p + sizeof(BookHeader));
+            numEntries_ = header->entries;
+            moves_ = reinterpret_cast<const BookMove*>(p + sizeof(BookHeader) + header->entries * sizeof(BookEntry));
+            numMoves_ = header->moves;
+            return true;
+        }
+        void close(){
+#ifdef _WIN32
+            buffer_.clear();
+#else
+            if(map_ != nullptr){
+                munmap(map_, mapSize_);
+            }
+            map_ = nullptr;
+            mapSize_ = 0;
+#endif
+            entries_ = nullptr; moves_ = nullptr;
+            numEntries_ = numMoves_ = 0;
+        }
+        
+        size_t size()const noexcept{ return numEntries_; }
+        bool empty()const noexcept{ return numEntries_ == 0; }
+        
+        const BookEntry* find(uint64_t key)const{
+            // キーはほぼ一様に分布しているので内挿探索する
+            // 偏っていた場合に備えて数回で二分探索に切り替える
+            if(empty()){ return nullptr; }
+            size_t lo = 0, hi = numEntries_ - 1;
+            for(int i = 0; i < 8 && lo < hi; ++i){
+                const uint64_t kl = entries_[lo].key, kh = entries_[hi].key;
+                if(key < kl || kh < key){ return nullptr; }
+                const size_t mid = lo + static_cast<size_t>(double(key - kl) / double(kh - kl) * (hi - lo));
+                if(entries_[mid].key == key){ return &entries_[mid]; }
+                if(entries_[mid].key < key){ lo = mid + 1; }else{ hi = mid; }
+            }
+            const BookEntry *const e = std::lower_bound(entries_ + lo, entries_ + hi + 1, key,
+                                                        [](const BookEntry& be, uint64_t k)->bool{ return be.key < k; });
+            return (e != entries_ + hi + 1 && e->key == key) ? e : nullptr;
+        }
+        const BookMove* moves(const BookEntry& e)const noexcept{
+            return moves_ + e.firstMove;
+        }
+        
+        template<class board_t>
+        Move probe(const board_t& bd, BookMove *const pbm = nullptr)const{
+            // 最も点の高い候補手を盤面の座標で返す(無ければ kMoveNone)
+            int pat;
+            const BookEntry *const e = find(calcRepRelativeHash(bd, pat));
+            if(e == nullptr || e->moves == 0){ return kMoveNone; }
+            const BookMove *const bm = std::max_element(moves(*e), moves(*e) + e->moves,
+                                                        [](const BookMove& a, const BookMove& b)->bool{
+                                                            return a.score < b.score;
+                                                        });
+            if(pbm != nullptr){ *pbm = *bm; }
+            return fromSymmetryMove(bm->symmetryMove(), bd, pat);
+        }
+        
+        static bool write(const std::string& path, const std::map<uint64_t, std::vector<BookMove>>& book){
+            // キーの昇順に並べて書き出す(std::map なので既に並んでいる)
+            std::ofstream ofs(path, std::ios::binary);
+            if(!ofs){ return false; }
+            BookHeader header;
+            memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.entries = book.size();
+            header.moves = 0;
+            header.reserved = 0;
+            for(const auto& kv : book){
+                header.moves += kv.second.size();
+            }
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            uint32_t firstMove = 0;
+            for(const auto& kv : book){
+                BookEntry e;
+                e.key = kv.first;
+                e.firstMove = firstMove;
+                e.moves = kv.second.size();
+                e.reserved = 0;
+                ofs.write(reinterpret_cast<const char*>(&e), sizeof(e));
+                firstMove += kv.second.size();
+            }
+            for(const auto& kv : book){
+                ofs.write(reinterpret_cast<const char*>(kv.second.data()), kv.second.size() * sizeof(BookMove));
+            }
+            return bool(ofs);
+        }
+        
+        Book(){}
+        ~Book(){ close(); }
+        Book(const Book&) = delete;
+        Book& operator=(const Book&) = delete;
+    
+    private:
+        const BookEntry *entries_ = nullptr;
+        const BookMove *moves_ = nullptr;
+        size_t numEntries_ = 0, numMoves_ = 0;
+#ifdef _WIN32
+        std::vector<char> buffer_;
+#else
+        void *map_ = nullptr;
+        size_t mapSize_ = 0;
+#endif
+    };
+    
+    constexpr char Book::kMagic[8];
+}
+
+#endif // TRAX_BOOK_HPP_
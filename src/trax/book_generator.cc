@@ -0,0 +1,347 @@
+/*
+ book_generator.cc
+ Katsuki Ohto
+ */
+
+// 定跡生成
+// 初期局面から幅優先で定跡木を展開し、末端を含む各局面を探索部による固定深さ探索で評価して
+// ミニマックスで点を戻した上でバイナリ定跡(book.hpp)を書き出す
+// 探索部の大域変数は1組しか無いので、局面単位の並列化はプロセスを分けて行う
+// 探索結果は作業ファイルに1局面1行で追記するので、途中で止めても同じ作業ファイルを指定すれば続きから再開できる
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "kizuna.h"
+
+uint64_t LIMIT_TIME = -1; // 時間では止めず、深さ制限で止める
+
+#include "search.hpp"
+
+#include <set>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+using namespace Trax;
+
+struct BookNode{
+    std::vector<std::string> record; // 初期局面からの手順(代表の1つ)
+    
+    // 展開した子局面
+    std::vector<Move> moves;
+    std::vector<uint64_t> childKeys; // 終局する手では 0
+    std::vector<int> terminalScores; // 終局する手の点
+    
+    bool searched = false;
+    int depth = 0, score = 0;
+    std::string bestMove;
+    
+    bool backedUp = false;
+    int value = 0;
+};
+
+std::map<uint64_t, BookNode> tree;
+
+void replay(const std::vector<std::string>& record, Node *const pnd){
+    pnd->clear();
+    for(const std::string& str : record){
+        Move mv = readMoveNotation(str, *pnd);
+        pnd->makeMove(mv);
+    }
+}
+
+int loadWorkFile(const std::string& path){
+    // 探索済みの結果を読み込む
+    // 形式 : キー 深さ 点 最善手 手順...
+    std::ifstream ifs(path);
+    int cnt = 0;
+    std::string line;
+    while(std::getline(ifs, line)){
+        std::istringstream iss(line);
+        uint64_t key; int depth, score; std::string bestMove;
+        if(!(iss >> key >> depth >> score >> bestMove)){ continue; } // 書きかけの行
+        auto itr = tree.find(key);
+        if(itr == tree.end()){ continue; } // 今回の設定では展開しない局面
+        BookNode& node = itr->second;
+        if(!node.searched || node.depth < depth){
+            node.searched = true;
+            node.depth = depth;
+            node.score = score;
+            node.bestMove = bestMove;
+            cnt += 1;
+        }
+    }
+    return cnt;
+}
+
+void expandTree(int plies, int width){
+    // 幅優先で展開し、対称形で同じになる局面はまとめる
+    Node nd;
+    std::vector<uint64_t> level;
+    int pat;
+    nd.clear();
+    const uint64_t rootKey = calcRepRelativeHash(nd, pat);
+    tree[rootKey];
+    level.push_back(rootKey);
+    
+    for(int ply = 0; ply < plies; ++ply){
+        std::vector<uint64_t> nextLevel;
+        for(uint64_t key : level){
+            BookNode& node = tree[key];
+            replay(node.record, &nd);
+            const Color myColor = nd.turnColor();
+            
+            // 静的評価で並べて上位 width 手を展開する
+            std::vector<std::tuple<int, Move, uint64_t>> candidates;
+            std::set<std::string> terminalNotations; // 勝敗の決まる手の表記
+            for(Move mv : generateMoveVector<Move, true>(nd)){
+                const int ret = nd.makeMove(mv);
+                if(ret < 0){ continue; } // 失敗した着手は makeMove の中で戻されている
+                uint64_t childKey = 0;
+                int score;
+                if(ret & (Rule::WON << myColor)){
+                    score = +kScoreMate - static_cast<int>(nd.turn);
+                }else if(ret & (Rule::WON << flipColor(myColor))){
+                    score = -kScoreMate + static_cast<int>(nd.turn);
+                }else{
+                    childKey = calcRepRelativeHash(nd, pat);
+                    score = -nd.evaluate(nd.turnColor());
+                }
+                nd.unmakeMove();
+                // 対称な手は1つにまとめる
+                // 勝敗の決まる手は局面のキーが無いので表記でまとめる(線の両端から同じ手が生成される)
+                if(childKey == 0){
+                    if(!terminalNotations.insert(toNotationString(mv, nd)).second){ continue; }
+                }else if(std::find_if(candidates.begin(), candidates.end(), [childKey](const auto& c)->bool{
+                    return std::get<2>(c) == childKey;
+                })!= candidates.end()){
+                    continue;
+                }
+                candidates.emplace_back(score, mv, childKey);
+            }
+            std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b)->bool{
+                return std::get<0>(a) > std::get<0>(b);
+            });
+            if(candidates.size() > width){ candidates.resize(width); }
+            
+            for(const auto& c : candidates){
+                const Move mv = std::get<1>(c);
+                const uint64_t childKey = std::get<2>(c);
+                node.moves.push_back(mv);
+                node.childKeys.push_back(childKey);
+                node.terminalScores.push_back(childKey == 0 ? std::get<0>(c) : 0);
+                if(childKey != 0 && !tree.count(childKey)){
+                    BookNode& child = tree[childKey]; // node への参照は std::map なので無効にならない
+                    child.record = node.record;
+                    child.record.push_back(toNotationString(mv, nd));
+                    nextLevel.push_back(childKey);
+                }
+            }
+        }
+        cerr << "ply " << (ply + 1) << " : " << nextLevel.size() << " new positions" << endl;
+        level = std::move(nextLevel);
+    }
+}
+
+void searchPositions(const std::vector<uint64_t>& keys, int proc, int numProcs,
+                     const std::string& workFilePath){
+    // keys のうち proc 番目の担当分を探索して作業ファイルに追記する
+    const int fd = ::open(workFilePath.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if(fd < 0){
+        cerr << "failed to open " << workFilePath << endl;
+        return;
+    }
+    for(size_t i = proc; i < keys.size(); i += numProcs){
+        const BookNode& node = tree[keys[i]];
+        Board& bd = Global::rootBoard;
+        bd.clear();
+        for(const std::string& str : node.record){
+            bd.makeMove(readMoveNotation(str, bd));
+        }
+        
+        Global::rootColor = bd.turnColor();
+        Global::syncNodes();
+        Global::signals = 0;
+        Global::clock.start();
+        auto best = Global::visitNode(0, [](auto& nd)->MoveScoreDepth{
+            using node_t = std::decay_t<decltype(nd)>;
+            MoveScoreDepth best = Global::manager.ParallelSearch(nd, {}, {}, 1);
+            best.set(convertMove<node_t::size(), SIZE>(Move(best)));
+            return best;
+        });
+        
+        // 1行を1回の write で書くので、プロセス間で行が混ざらない
+        std::ostringstream oss;
+        oss << keys[i] << " " << best.depth << " " << best.score << " "
+        << (Move(best) == kMoveNone ? "-" : toNotationString(Move(best), bd));
+        for(const std::string& str : node.record){
+            oss << " " << str;
+        }
+        oss << "\n";
+        const std::string line = oss.str();
+        if(::write(fd, line.data(), line.size()) != (ssize_t)line.size()){
+            cerr << "failed to write " << workFilePath << endl;
+        }
+        cout << "proc " << proc << " : " << (i / numProcs + 1) << " / " << ((keys.size() - proc + numProcs - 1) / numProcs)
+        << " " << best.score << " " << toString(node.record, " ") << endl;
+    }
+    ::close(fd);
+}
+
+int backUp(uint64_t key){
+    // 展開した子局面の点から負値最大で戻す
+    BookNode& node = tree[key];
+    if(node.backedUp){ return node.value; }
+    int value = node.score; // 末端では探索の点そのまま
+    if(!node.moves.empty()){
+        value = -kScoreInfinite;
+        for(size_t i = 0; i < node.moves.size(); ++i){
+            const int score = node.childKeys[i] == 0 ? node.terminalScores[i] : -backUp(node.childKeys[i]);
+            value = max(value, score);
+        }
+        // 探索の方が良い手を見つけていればそちらを信じる
+        value = max(value, node.score);
+    }
+    node.backedUp = true;
+    node.value = value;
+    return value;
+}
+
+int main(int argc, char* argv[]){
+    
+    setvbuf(stdout, NULL, _IONBF, 0);
+    
+    std::string bookFilePath = "./data/book.bin";
+    std::string workFilePath = "./data/book_work.txt";
+    int plies = 4; // 定跡木の深さ
+    int width = 8; // 各局面で展開する手の数
+    int searchDepth = 8; // 各局面の探索深さ
+    int numProcs = 1; // 並列に探索するプロセス数
+    int hashMegaBytes = 256; // プロセスごとの置換表の大きさ
+    bool verbose = false;
+    Global::numThreads = 1;
+    
+    for(int c = 1; c < argc; ++c){
+        if(!strcmp(argv[c], "-o")){
+            bookFilePath = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-w")){
+            workFilePath = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-p")){
+            plies = max(0, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-width")){
+            width = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-d")){
+            searchDepth = max(1, min(atoi(argv[c + 1]), int(kMaxPly)));
+        }else if(!strcmp(argv[c], "-j")){
+            numProcs = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-th")){
+            Global::numThreads = max(1, min(atoi(argv[c + 1]), int(N_THREADS)));
+        }else if(!strcmp(argv[c], "-hash")){
+            hashMegaBytes = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-v")){
+            verbose = true;
+        }
+    }
+#ifdef _WIN32
+    numProcs = 1; // fork が無い
+#endif
+    
+    Trax::initTrax();
+    Global::dice.srand((unsigned int)time(NULL));
+    Global::searchDepthLimit = searchDepth;
+    Global::reportStopLatency = false;
+    
+    // 定跡木を展開し、作業ファイルから探索済みの結果を読む
+    expandTree(plies, width);
+    const int loaded = loadWorkFile(workFilePath);
+    std::vector<uint64_t> keys;
+    for(const auto& kv : tree){
+        if(!kv.second.searched || kv.second.depth < searchDepth){
+            keys.push_back(kv.first);
+        }
+    }
+    cerr << tree.size() << " positions, " << loaded << " loaded from " << workFilePath
+    << ", " << keys.size() << " to search with " << numProcs << " processes" << endl;
+    
+    auto initSearch = [&]()->void{
+        // 置換表は子プロセスごとに確保する
+        Global::tt.Clear();
+        Global::tt.SetSize(hashMegaBytes);
+        Global::evalHash.SetSize(Global::evalHashMegaBytes);
+        Global::manager.SetNumSearchThreads(Global::numThreads);
+        if(!verbose){ // 探索の途中経過は捨てる
+            if(freopen("/dev/null", "w", stderr) == nullptr){}
+        }
+    };
+    
+    if(!keys.empty()){
+#ifdef _WIN32
+        initSearch();
+        searchPositions(keys, 0, 1, workFilePath);
+#else
+        std::vector<pid_t> children;
+        for(int proc = 0; proc < numProcs; ++proc){
+            const pid_t pid = fork();
+            if(pid == 0){
+                initSearch();
+                searchPositions(keys, proc, numProcs, workFilePath);
+                _exit(0);
+            }else if(pid < 0){
+                cerr << "failed to fork." << endl;
+            }else{
+                children.push_back(pid);
+            }
+        }
+        for(pid_t pid : children){
+            int status;
+            waitpid(pid, &status, 0);
+        }
+#endif
+        loadWorkFile(workFilePath);
+    }
+    
+    // 全局面の探索が揃っていなければ書き出さない
+    for(const auto& kv : tree){
+        if(!kv.second.searched){
+            cerr << "some positions are not searched. run again with the same work file to resume." << endl;
+            return 1;
+        }
+    }
+    
+    // ミニマックスで点を戻して定跡を作る
+    Node nd;
+    int pat;
+    nd.clear();
+    const int rootValue = backUp(calcRepRelativeHash(nd, pat));
+    std::map<uint64_t, std::vector<BookMove>> book;
+    for(auto& kv : tree){
+        BookNode& node = kv.second;
+        replay(node.record, &nd);
+        calcRepRelativeHash(nd, pat); // 候補手を代表の対称型に合わせる
+        std::vector<BookMove>& bms = book[kv.first];
+        const int depth = searchDepth + plies - static_cast<int>(node.record.size());
+        for(size_t i = 0; i < node.moves.size(); ++i){
+            const int score = node.childKeys[i] == 0 ? node.terminalScores[i] : -tree[node.childKeys[i]].value;
+            bms.emplace_back(toSymmetryMove(node.moves[i], nd, pat), score, depth);
+        }
+        // 探索の最善手が展開した手に無ければ加える
+        if(node.bestMove != "-"){
+            const Move mv = readMoveNotation(node.bestMove, nd);
+            if(mv != kMoveNone
+               && std::none_of(node.moves.begin(), node.moves.end(), [&](const Move& m)->bool{
+                return toNotationString(m, nd) == node.bestMove;
+            })){
+                bms.emplace_back(toSymmetryMove(mv, nd, pat), node.score, searchDepth);
+            }
+        }
+        if(bms.empty()){ book.erase(kv.first); }
+    }
+    if(!Book::write(bookFilePath, book)){
+        cerr << "failed to write " << bookFilePath << endl;
+        return 1;
+    }
+    cerr << "wrote " << book.size() << " positions to " << bookFilePath << " (root value = " << rootValue << ")" << endl;
+    
+    return 0;
+}
@@ -10,6 +10,8 @@
 uint64_t LIMIT_TIME = 750;
 
 #include "search.hpp"
+#include "bench.hpp"
+#include "perft.hpp"
 
 //#if defined(CERR)
 //#undef CERR
@@ -19,36 +21,41 @@ const std::string MY_DEFAULT_CODE = "KZ";
 const std::string MY_NAME = "KizuNa";
 const std::string MY_VERSION = "160907";
 
+// ログは書き出しスレッドに渡すだけで、ファイルや端末への書き込みを待たない
 void outputCommunicationLog(const std::string& str){
-    std::ofstream ofs;
-    ofs.open("./kizuna_communication.log", std::ios::app);
-    if(!ofs){
-        cerr << "failed to open log file." << endl;
-    }
-    ofs << getpid() << " " << str; // プロセスID付きでログを残す
-    ofs.close();
+    Global::logger.push(kLogInfo, kLogCommunication, std::string(str));
 }
 
 void outputErrorLog(const std::string& str){
-    std::ofstream ofs;
-    ofs.open("./kizuna.log", std::ios::app);
-    if(!ofs){
-        cerr << "failed to open log file." << endl;
+    // 標準エラー出力とエラーログ(./kizuna.log)の両方に書く
+    Global::logger.push(kLogError, kLogStderr, str + "\n");
+}
+
+void outputBoardLog(const Trax::Board& bd){
+    // 盤面の表示は重いのでデバッグ時(-v)のみ
+    if(Global::logger.enabled(kLogDebug)){
+        Global::logger.push(kLogDebug, kLogStderr, bd.toString());
     }
-    ofs << getpid() << " " << str; // プロセスID付きでログを残す
-    ofs.close();
 }
 
 bool recvMessage(std::string *const pstr){
+    const uint64_t begin = Global::timeline.enabled() ? Global::timeline.now() : 0;
     if(!(std::cin >> *pstr)){
         return false;
     }
+    if(Global::timeline.enabled()){
+        Global::timeline.span("recv", TimelineRecorder::kMainThread, begin, Global::timeline.now());
+    }
     outputCommunicationLog(">> " + *pstr + "\n");
     return true;
 }
 
 bool sendMessage(const std::string& str){
+    const uint64_t begin = Global::timeline.enabled() ? Global::timeline.now() : 0;
     std::cout << str << std::endl;
+    if(Global::timeline.enabled()){
+        Global::timeline.span("send", TimelineRecorder::kMainThread, begin, Global::timeline.now());
+    }
     outputCommunicationLog("<< " + str + "\n");
     return true;
 }
@@ -56,26 +63,36 @@ bool sendMessage(const std::string& str){
 Trax::Move think(Trax::Board& bd){
     
     CERR << " *** Thinking Phase ***" << endl;
-
-    //Trax::Easy::moves = 0;
-    //auto mvsc = Trax::Easy::searchRoot(max(4, 8 - bd.turn / 2), bd);
     
-    for(int th = 0; th < N_THREADS; ++th){
-        Global::node[th].unmakeMove(0); // 初期局面まで戻す
-    }
-    for(const auto& nt : Global::record){
-        Move mv = readMoveNotation(nt, Global::node[0]);
-        //cerr << mv << endl;
-        for(int th = 0; th < N_THREADS; ++th){
-            Global::node[th].makeMove(mv);
+    // 定跡にあれば探索せずに指す(8x8 Trax は規則が違うので使わない)
+    if(!Global::variant8x8){
+        BookMove bm;
+        Move mv = Global::book.probe(bd, &bm);
+        if(mv != kMoveNone && bd.isLegalMove(mv)){
+            CERR << "book best = " << bm.score << " " << toNotationString(mv, bd) << " depth = " << int(bm.depth) << " chosen" << endl;
+            return mv;
         }
     }
     
-    Node& node = Global::node[0];
+    //Trax::Easy::moves = 0;
+    //auto mvsc = Trax::Easy::searchRoot(max(4, 8 - bd.turn / 2), bd);
     
-    Global::manager.SetNumSearchThreads(N_THREADS);
+    // 各スレッドの盤面をルート局面に合わせる(前回の探索からの差分の着手だけを進める)
+    Global::syncNodes();
+    if(Global::search8x8){
+        CERR << "search on the 8x8 bitboard" << endl;
+    }else if(Global::wideSearch){
+        CERR << "search on the wide board (" << SIZE << " x " << SIZE << ")" << endl;
+    }
+    
+    Global::manager.SetNumSearchThreads(Global::numThreads);
     Global::signals = 0;
-    auto bestMove = Global::manager.ParallelSearch(node, {}, {}, 1);
+    auto bestMove = Global::visitNode(0, [](auto& node)->MoveScoreDepth{
+        using node_t = std::decay_t<decltype(node)>;
+        MoveScoreDepth best = Global::manager.ParallelSearch(node, {}, {}, 1);
+        best.set(convertMove<node_t::size(), SIZE>(Move(best))); // ルート局面での着手に戻す
+        return best;
+    });
     
     //CERR << "best move = " << bestMove << " " << toNotationString(bestMove.pv, bd) << endl;
     //CERR << "best score = " << std::get<1>(mvsc) << endl;
@@ -84,40 +101,6 @@ Trax::Move think(Trax::Board& bd){
     //CERR << " best = " << bestMove.score << " " << toString(toNotationStrings(bestMove.pv, bd), " ") << endl;
     CERR << "search best = " << bestMove.score << " " << toNotationString(Move(bestMove), bd) << " depth = " << bestMove.depth << endl;
     
-    // 探索が終了したので定跡を見る
-    /*int pat = 0;
-    uint64_t rhash = calcRepRelativeHash(bd, pat); // 対称性を考慮した局面ハッシュ値を取得(同時に回転方向も得る)
-    auto *pBookEntry = Global::book.read(rhash);
-    if(pBookEntry != nullptr){ // 定跡から発見
-        RelativeMoveScore bestBookMove = RelativeMoveScore(kRelativeMoveNone, 0);
-        if(bd.turn <= 2){
-            bestBookMove = pBookEntry->bestMove();
-        }else{
-            //int depth = pBookEntry->depth;
-            //if(depth >= bestMove.depth){
-            //    // より深い探索がなされていた場合には定跡データで着手を決定
-            //    bestBookMove = pBookEntry->softmaxMove(800 / double(sqrt(bd.turn + 1)), &Global::dice);
-            //}
-        }
-        if(bestBookMove != kRelativeMoveNone){
-            // 対称変換を元に戻す(実際の局面でのタイルバウンド情報が必要)
-            RelativeMoveBound rmv = symmetryTransform(invSymmetryTransform(RelativeMoveBound(bestBookMove, bd.dx() + 2, bd.dy() + 2),
-                                                                           pBookEntry->pattern),
-                                                      pat);
-            
-            Move mv = toMove(rmv, bd);
-            
-            //CERR << "book move = " << toNotationString(mv, bd) << endl;
-            
-            // 合法性がチェックされればこの着手で決定
-            if(1 &&
-               bd.isLegalMove(mv)){
-                CERR << "book best = " << bestBookMove.score << " " << toNotationString(mv, bd) << " depth = " << pBookEntry->depth << " chosen" << endl;
-                return mv;
-            }
-        }
-    }*/
-    
     //return std::get<0>(mvsc);
     return Move(bestMove);
     
@@ -129,32 +112,18 @@ void startPondering(){
     
     CERR << " *** Pondering Phase ***" << endl;
     
-    for(int th = 0; th < N_THREADS; ++th){
-        Global::node[th].unmakeMove(0); // 初期局面まで戻す
-    }
-    for(const auto& nt : Global::record){
-        Move mv = readMoveNotation(nt, Global::node[0]);
-        //cerr << mv << endl;
-        for(int th = 0; th < N_THREADS; ++th){
-            Global::node[th].makeMove(mv);
-        }
-    }
+    Global::syncNodes();
     
-    Global::initStats(); // スタッツ初期化
-    Global::manager.SetNumSearchThreads(N_THREADS);
     Global::signals = 0;
     
-    // ワーカースレッドの探索を開始する
-    for (auto& worker : Global::manager.worker_threads_) {
-        worker->StartSearching();
-    }
+    // マスタースレッドも含めて全てのスレッドで先読みする
+    Global::visitNode(0, [](auto& node)->void{
+        Global::manager.StartPondering(node, Global::numPonderThreads, Global::lowPonderPriority);
+    });
 }
 
 void finishPondering(){
-    Global::signals |= Global::SIGNAL_STOP; // stop signal
-    for (auto& worker : Global::manager.worker_threads_) {
-        worker->WaitUntilSearchIsFinished();
-    }
+    Global::manager.FinishPondering();
 }
 
 int gameLoop(Trax::Board& bd, const Trax::Color myColor){ // main loop to proceed game
@@ -175,21 +144,25 @@ int gameLoop(Trax::Board& bd, const Trax::Color myColor){ // main loop to procee
                     move = readMoveNotation("@0/", bd);
                 }
             }else{
+                const uint64_t begin = Global::timeline.enabled() ? Global::timeline.now() : 0;
                 move = think(bd); // decide my move
+                if(Global::timeline.enabled()){
+                    Global::timeline.span("think", TimelineRecorder::kMainThread, begin, Global::timeline.now(), bd.turn);
+                }
             }
             
             CERR << " *** finished Thinking Move ***" << endl;
             
             std::string notationString = toNotationString(move, bd);
             if(!sendMessage(notationString)){ // send move
-                CERR << "failed to send my move." << endl;
+                outputErrorLog("failed to send my move.");
                 break;
             }
             Global::clock.start(); // start clock for pondering
             Global::record.push_back(notationString);
             ret = bd.makeMove(move);
             if(ret < 0){
-                CERR << "my violation?" << endl; break;
+                outputErrorLog("my violation?"); break;
             }
         }else{ // opponent turn
             
@@ -202,7 +175,12 @@ int gameLoop(Trax::Board& bd, const Trax::Color myColor){ // main loop to procee
             std::string oppNotationString;
             
             if(!recvMessage(&oppNotationString)){
-                CERR << "failed to receive opponent's move." << endl;
+                outputErrorLog("failed to receive opponent's move.");
+#ifdef PONDER
+                if(Global::pondering){
+                    finishPondering(); // 先読みスレッドを残したまま終了しない
+                }
+#endif
                 break;
             }
             // got message
@@ -233,14 +211,19 @@ int gameLoop(Trax::Board& bd, const Trax::Color myColor){ // main loop to procee
                 //CERR << oppNotationString << endl;
                 //CERR << oppMove << endl;
                 if(oppMove == kMoveNone){
-                    CERR << "opponent move was unrecognized." << endl;
+                    outputErrorLog("opponent move was unrecognized.");
                     continue;
                 }
                 CERR << "opponent move = " << oppMove << " in notation " << toNotationString(oppMove, bd) << endl;
                 Global::record.push_back(oppNotationString);
                 ret = bd.makeMove(oppMove);
+                if(ret >= 0 && Global::variant8x8 && !Global::fits8x8Node(bd)){
+                    // 8x8 Trax ではタイルの範囲が 8x8 を超える着手は反則
+                    bd.unmakeMove();
+                    ret = OUT_BOARD;
+                }
                 if(ret < 0){
-                    CERR << "opponent violation!" << endl;
+                    outputErrorLog("opponent violation!");
 #ifdef ENGINE
                     continue;
 #else
@@ -249,7 +232,7 @@ int gameLoop(Trax::Board& bd, const Trax::Color myColor){ // main loop to procee
                 }
             }
         }
-        CERR << bd.toString();
+        outputBoardLog(bd);
         if(!bd.exam(ret == 0)){
             return -1;
         }
@@ -280,9 +263,14 @@ int main(int argc, char* argv[]){
     std::string host = "127.0.0.1";
     int port = 10001;
     std::string myCode = MY_DEFAULT_CODE;
-    std::string bookFilePath = "./data/book.txt";
+    std::string bookFilePath = "./data/book.bin";
     std::string evalParamFilePath = "./data/eval_params.dat";
-    int numThreads = N_THREADS;
+    std::string telemetryFilePath; // 空でなければ探索の経過を JSON で書き出す
+    int benchDepth = 0; // 0 でなければベンチマークを行って終了する
+    int scalingDepth = 0; // 0 でなければスレッド数ごとのベンチマークを行って終了する
+    int perftDepth = 0; // 0 でなければ perft を行って終了する
+    std::vector<std::string> perftRecord; // perft の開始局面までの棋譜
+    int perftHashMegaBytes = 0; // perft の置換表の大きさ(0 なら使わない)
     
     // receive arguments
     for(int c = 1; c < argc; ++c){
@@ -297,9 +285,37 @@ int main(int argc, char* argv[]){
         }else if(!strcmp(argv[c], "-np")){
             Global::pondering = false;
         }else if(!strcmp(argv[c], "-pi")){
-            //evalParamFilePath = std::string(argv[c + 1]);
+            evalParamFilePath = std::string(argv[c + 1]);
         }else if(!strcmp(argv[c], "-th")){
-            numThreads = atoi(argv[c + 1]);
+            Global::numThreads = max(1, min(atoi(argv[c + 1]), int(N_THREADS)));
+        }else if(!strcmp(argv[c], "-pth")){
+            Global::numPonderThreads = max(1, min(atoi(argv[c + 1]), int(N_THREADS)));
+        }else if(!strcmp(argv[c], "-pl")){
+            Global::lowPonderPriority = true;
+        }else if(!strcmp(argv[c], "-8")){
+            Global::variant8x8 = true;
+        }else if(!strcmp(argv[c], "-perf")){
+            Global::perfCounting = true;
+        }else if(!strcmp(argv[c], "-tl")){
+            telemetryFilePath = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-v")){
+            Global::logger.setLevel(kLogDebug);
+        }else if(!strcmp(argv[c], "-trace")){
+            Global::timeline.open(std::string(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-eh")){
+            Global::evalHashMegaBytes = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "bench")){
+            benchDepth = (c + 1 < argc && isdigit(argv[c + 1][0])) ? atoi(argv[c + 1]) : kBenchDepth;
+        }else if(!strcmp(argv[c], "scaling")){
+            scalingDepth = (c + 1 < argc && isdigit(argv[c + 1][0])) ? atoi(argv[c + 1]) : kBenchDepth;
+        }else if(!strcmp(argv[c], "perft")){
+            perftDepth = (c + 1 < argc) ? max(1, atoi(argv[c + 1])) : 1;
+            for(c += 2; c < argc && argv[c][0] != '-'; ++c){
+                perftRecord.push_back(std::string(argv[c]));
+            }
+            --c;
+        }else if(!strcmp(argv[c], "-ph")){
+            perftHashMegaBytes = max(0, atoi(argv[c + 1]));
         }
     }
     
@@ -309,18 +325,69 @@ int main(int argc, char* argv[]){
     Global::rootColor = RED;
     Global::tt.Clear();
     Global::tt.SetSize(1024);
-    //Global::book.fin(bookFilePath);
-    Global::manager.SetNumSearchThreads(numThreads);
-    /*{
-        std::ifstream ifs(evalParamFilePath);
-        while(ifs){
-            double val;
-            ifs >> val;
-            Global::evalParams.push_back(int(val));
+    Global::evalHash.SetSize(Global::evalHashMegaBytes);
+    if(Global::book.open(bookFilePath)){
+        CERR << "opened book " << bookFilePath << " (" << Global::book.size() << " positions)" << endl;
+    }
+    // 思考と先読みのどちらにも足りるだけのスレッドを最初に作っておき、以後は参加する数だけを切り替える
+    Global::manager.ReserveSearchThreads(Global::pondering ? max(Global::numThreads, Global::numPonderThreads) : Global::numThreads);
+    Global::manager.SetNumSearchThreads(Global::numThreads);
+    if(evalParams.load(evalParamFilePath)){ // 無ければ埋め込みの値のまま
+        CERR << "loaded evaluation parameters " << evalParamFilePath << endl;
+    }
+    if(!telemetryFilePath.empty() && !Global::telemetry.open(telemetryFilePath)){
+        CERR << "failed to open telemetry file " << telemetryFilePath << endl;
+    }
+    
+    if(benchDepth > 0){
+        LIMIT_TIME = -1;
+        if(Global::variant8x8){
+            bench8x8(benchDepth, std::cout); // 通常の盤面との速度比較
+        }else{
+            bench(benchDepth, std::cout);
+        }
+        return 0;
+    }
+    if(scalingDepth > 0){
+        LIMIT_TIME = -1;
+        scalingBench(scalingDepth, Global::numThreads, std::cout);
+        return 0;
+    }
+    if(perftDepth > 0){
+        std::unique_ptr<Board> pbd(new Board);
+        Board& root = *pbd;
+        root.clear();
+        for(const std::string& notation : perftRecord){
+            const Move move = readMoveNotation(notation, root);
+            if(move == kMoveNone || root.makeMove(move) != 0){
+                CERR << "unrecognized move " << notation << endl;
+                return 1;
+            }
+        }
+        PerftTable table;
+        if(perftHashMegaBytes > 0){
+            table.SetSize(perftHashMegaBytes);
         }
-    }*/
+        PerftTable *const ptable = table.empty() ? nullptr : &table;
+        ClockMS clock;
+        clock.start();
+        const PerftResult r = (Global::numThreads > 1)
+        ? parallelPerft(root, perftDepth, Global::numThreads, ptable)
+        : perft(root, perftDepth, ptable);
+        const uint64_t ms = max(uint64_t(clock.stop()), uint64_t(1));
+        std::cout << "perft " << perftDepth << " : leaves " << r.leaves << " illegal " << r.illegal
+        << " terminal " << r.terminal << " nodes " << r.nodes << endl;
+        std::cout << "time " << ms << " ms " << (r.nodes * 1000 / ms) << " nodes/s" << endl;
+        return 0;
+    }
+    
+    // 対局時のみ、標準エラー出力と通信ログを書き出しスレッドから出力する
+    if(!Global::logger.start("./kizuna_communication.log", "./kizuna.log")){
+        cerr << "failed to open log file." << endl;
+    }
+    Global::logger.redirect(cerr);
     
-    Node& bd = Global::node[0];
+    Board& bd = Global::rootBoard;
     bd.clear();
     int rv = 0; // return value of latest makemove
     
@@ -380,12 +447,12 @@ int main(int argc, char* argv[]){
             if(move == kMoveNone){ CERR << "unrecognized move." << endl; break; }
             rv = bd.makeMove(move);
             Global::record.push_back(notationString);
-            CERR << bd.toString();
+            outputBoardLog(bd);
         }else if(command == "-U"){ // undo 1 move
             bd.unmakeMove();
             rv = 0;
             Global::record.pop_back();
-            CERR << bd.toString();
+            outputBoardLog(bd);
         }else if(command == "-R"){ // record
             // record reading mode
             std::string notationString;
@@ -397,19 +464,30 @@ int main(int argc, char* argv[]){
                 if(move == kMoveNone){ CERR << "unrecognized move." << endl; break; }
                 rv = bd.makeMove(move);
                 Global::record.push_back(notationString);
-                CERR << bd.toString();
+                outputBoardLog(bd);
             }
         }else if(command == "-I"){ // initialize board
             bd.clear();
             rv = 0;
             Global::record.clear();
-            CERR << bd.toString();
+            outputBoardLog(bd);
         }else if(command == "-J"){ // judge game result
             std::ostringstream oss;
             oss << rv;
             sendMessage(oss.str());
         }else if(command == "-E"){ // exit program
             break;
+        }else if(command == "-P"){ // reload evaluation parameters
+            std::string path;
+            recvMessage(&path);
+            if(evalParams.load(path)){
+                // 古いパラメータでの評価点が残らないようにする
+                Global::tt.Clear();
+                Global::evalHash.Clear();
+                CERR << "loaded evaluation parameters " << path << endl;
+            }else{
+                CERR << "failed to load evaluation parameters " << path << endl;
+            }
         }else if(command == "-S"){ // unlimited search
             LIMIT_TIME = -1;
             Global::clock.start(); // start clock for thinking
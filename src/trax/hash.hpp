@@ -101,6 +101,10 @@ public:
                 if (move == kMoveNone) {
                     move = tte.move();
                 }
+                // 静的評価点も同様(局面が同じなら変わらない)
+                if (eval == kScoreNone && !tte.empty()) {
+                    eval = tte.eval();
+                }
                 
                 // ３手詰みをスキップ可能であるとのフラグがすでに存在するときは、そのフラグをそのまま残す
                 if (skip_mate3 == false) {
@@ -197,4 +201,136 @@ private:
     uint8_t age_;
 };
 
+class EvalHashTable{
+public:
+    
+    /**
+     * 静的評価点のキャッシュから、特定の局面の評価点を参照します.
+     * 1エントリを上位48ビットのキーと16ビットの評価点で64ビットに詰めているので、
+     * スレッド間で共有してもロック無しで壊れたデータを読むことはありません.
+     * @param key64 局面のハッシュ値（64ビット）
+     * @return 見つかった場合は手番側から見た評価点, 無ければ kScoreNone
+     */
+    Score LookUp(Key64 key64)const{
+        const uint64_t word = table_[key64 & key_mask_].load(std::memory_order_relaxed);
+        if (((word ^ key64) & kKeyMask) != 0) {
+            return kScoreNone;
+        }
+        return static_cast<Score>(static_cast<int16_t>(word & ~kKeyMask));
+    }
+    
+    /**
+     * 評価点を保存します(常に上書き).
+     */
+    void Save(Key64 key64, Score eval){
+        const uint64_t word = (key64 & kKeyMask) | static_cast<uint16_t>(static_cast<int16_t>(eval));
+        table_[key64 & key_mask_].store(word, std::memory_order_relaxed);
+    }
+    
+    /**
+     * 指定されたキーに対応するエントリのプリフェッチを行います.
+     */
+    void Prefetch(Key64 key) const {
+        __builtin_prefetch(&table_[key & key_mask_]);
+    }
+    
+    void Clear(){
+        for (size_t i = 0; i < size_; ++i) {
+            table_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    /**
+     * キャッシュの大きさを変更します.
+     * @param megabytes メモリ上に確保したい大きさ（メガバイト単位で指定）
+     */
+    void SetSize(size_t megabytes){
+        size_t bytes = megabytes * 1024 * 1024;
+        size_ = (static_cast<size_t>(1) << bsr<uint64_t>(bytes)) / sizeof(uint64_t);
+        key_mask_ = size_ - 1;
+        table_.reset(new std::atomic<uint64_t>[size_]);
+        Clear();
+    }
+    
+    size_t size() const { return size_; }
+    
+private:
+    /** キーの照合に使う上位48ビット(下位16ビットに評価点を入れる) */
+    static constexpr uint64_t kKeyMask = ~UINT64_C(0xFFFF);
+    
+    std::unique_ptr<std::atomic<uint64_t>[]> table_;
+    size_t size_ = 0;
+    size_t key_mask_ = 0;
+};
+
+class NodeVisitTable{
+public:
+    
+    /**
+     * 並列探索で各局面をどのスレッドが探索したかを記録し、他のスレッドと重複した探索を数えます(計測用).
+     * 1エントリを上位ビットのキーと下位 N_THREADS ビットのスレッドの集合で64ビットに詰めています.
+     * 衝突や競合で記録が失われることがあるので、数は近似値です.
+     * @param key64 局面のハッシュ値（64ビット）
+     * @param thread_id 探索しているスレッドの番号
+     */
+    void Visit(Key64 key64, size_t thread_id){
+        std::atomic<uint64_t>& word = table_[key64 & key_mask_];
+        const uint64_t tag = key64 & ~kThreadMask;
+        const uint64_t bit = UINT64_C(1) << thread_id;
+        ThreadCount& count = counts_[thread_id];
+        count.visits += 1;
+        if ((word.load(std::memory_order_relaxed) & ~kThreadMask) == tag) {
+            const uint64_t old = word.fetch_or(bit, std::memory_order_relaxed);
+            if (old & kThreadMask & ~bit) {
+                count.duplicates += 1; // 他のスレッドがすでに探索している
+            }
+        } else {
+            word.store(tag | bit, std::memory_order_relaxed);
+        }
+    }
+    
+    /** 記録した探索の数 */
+    uint64_t visits() const {
+        uint64_t sum = 0;
+        for (const ThreadCount& count : counts_) { sum += count.visits; }
+        return sum;
+    }
+    
+    /** そのうち他のスレッドと重複した探索の数 */
+    uint64_t duplicates() const {
+        uint64_t sum = 0;
+        for (const ThreadCount& count : counts_) { sum += count.duplicates; }
+        return sum;
+    }
+    
+    void Clear(){
+        for (size_t i = 0; i < size_; ++i) {
+            table_[i].store(0, std::memory_order_relaxed);
+        }
+        counts_.fill(ThreadCount());
+    }
+    
+    void SetSize(size_t megabytes){
+        size_t bytes = megabytes * 1024 * 1024;
+        size_ = (static_cast<size_t>(1) << bsr<uint64_t>(bytes)) / sizeof(uint64_t);
+        key_mask_ = size_ - 1;
+        table_.reset(new std::atomic<uint64_t>[size_]);
+        Clear();
+    }
+    
+private:
+    /** スレッドの集合を入れる下位ビット */
+    static constexpr uint64_t kThreadMask = (UINT64_C(1) << N_THREADS) - 1;
+    
+    /** スレッドごとの数(他のスレッドと同じキャッシュラインに書かないようにする) */
+    struct alignas(64) ThreadCount{
+        uint64_t visits = 0, duplicates = 0;
+    };
+    
+    std::unique_ptr<std::atomic<uint64_t>[]> table_;
+    std::array<ThreadCount, N_THREADS> counts_;
+    size_t size_ = 0;
+    size_t key_mask_ = 0;
+};
+
 #endif // TRAX_HASH_HPP_
@@ -8,14 +8,53 @@
 
 #include "trax.hpp"
 #include "board.hpp"
+#include "board8x8.hpp"
 
 #include "node.hpp"
 
-//#include "book.hpp"
+#include "book.hpp"
 #include "hash.hpp"
+#include "telemetry.hpp"
+#include "perf_counter.hpp"
+#include "timeline.hpp"
+#include "logger.hpp"
+
+namespace Trax{
+    // 探索用の盤面サイズ
+    // 実際の対局はほとんど 64 マス幅に収まるので通常は小さい盤面で探索し、
+    // 盤端に近づいたら最大サイズ(SIZE)の盤面に移行する
+    constexpr int NARROW_SIZE = 64;
+    constexpr int NARROW_MARGIN = 16; // 探索中に盤端に達しないための余裕
+}
 
 using Position = Trax::Board;
 using Node = Trax::TraxNode<Trax::Board>;
+using NarrowNode = Trax::TraxNode<Trax::BoardT<Trax::NARROW_SIZE>>;
+using Node8x8 = Trax::TraxNode<Trax::Board8x8>;
+
+namespace Trax{
+    namespace KizuNa{
+        // 探索の部分ごとの時間計測(PROFILE_SEARCH を定義したビルドのみ)
+        enum ProfilePart{
+            kProfileGenerate, kProfileMake, kProfileAttacks, kProfileEvaluate, kProfileTTProbe, kProfileTTStore,
+            kNumProfileParts
+        };
+        const char *const profilePartNames[kNumProfileParts] = {
+            "generate", "make", "checkSetAttacks", "evaluate", "tt probe", "tt store",
+        };
+    }
+}
+
+// 探索スレッドごとのアナライザで PROFILE_START から PROFILE_END までの CPU サイクル数を数える
+// 計測区間は入れ子にしない
+// 学習モードの探索はスレッド番号が N_THREADS を超えることがあるので数えない
+#ifdef PROFILE_SEARCH
+#define PROFILE_START if(!learning_mode_){ Global::searchProfilers[threadIndex_].start(); }
+#define PROFILE_END(part) if(!learning_mode_){ Global::searchProfilers[threadIndex_].end(KizuNa::part); }
+#else
+#define PROFILE_START
+#define PROFILE_END(part)
+#endif
 
 namespace Trax{
     
@@ -66,6 +105,9 @@ namespace Trax{
                 bool skipNullMove;
             };
             
+            template<class board_t>
+            Score evaluate(board_t& bd);
+            
             template<class board_t, class moveIterator_t>
             static std::tuple<Move, Score> searchRawMate(const Depth depth,
                                                          board_t& bd,
@@ -133,20 +175,46 @@ namespace Trax{
             
             void prepareSearch(){
                 clearSearchStack();
+                numNodesSearched = 0;
+                evalHashProbes_ = 0;
+                evalHashHits_ = 0;
+                ttProbes_ = 0;
+                ttHits_ = 0;
+                max_reach_ply_ = 0;
                 for(int c = 0; c < 2; ++c){
                     //historyStats_[c].clear();
                 }
             }
             
+            uint64_t nodesSearched()const{
+                return numNodesSearched;
+            }
+            uint64_t evalHashProbes()const{ return evalHashProbes_; }
+            uint64_t evalHashHits()const{ return evalHashHits_; }
+            uint64_t ttProbes()const{ return ttProbes_; }
+            uint64_t ttHits()const{ return ttHits_; }
+            
+            template<class board_t>
+            std::string toTelemetryString(board_t& bd, const MoveScoreDepth& best, int iteration, uint64_t iterationTime);
+            
             bool isMasterThread()const{
                 return threadIndex_ == 0;
             }
+            size_t threadIndex()const{
+                return threadIndex_;
+            }
             
             StackData* search_stack_at_ply(int ply) {
                 assert(0 <= ply && ply <= kMaxPly);
                 return stack_.begin() + 2 + ply; // stack_at_ply(0) - 2 の参照を可能にするため
             }
             
+            void setLearningMode(int depth){
+                // 自己対戦用に、他の探索と独立に固定深さで探索する
+                learning_mode_ = true;
+                learningDepth_ = depth;
+            }
+            
             void PrepareForNextSearch();
             Search(size_t threadIndex):
             threadIndex_(threadIndex){}
@@ -155,10 +223,13 @@ namespace Trax{
             static constexpr int kStackSize = kMaxPly + 6;
             
             //std::array<Score, 2> drawScores_{kScoreDraw, kScoreDraw};
-            uint64_t numNodesSearched;
-            int max_reach_ply_ = 0;
+            uint64_t numNodesSearched = 0; // このスレッドが探索したノード数
+            uint64_t evalHashProbes_ = 0, evalHashHits_ = 0; // このスレッドが評価点キャッシュを引いた回数と見つかった回数
+            uint64_t ttProbes_ = 0, ttHits_ = 0; // このスレッドが置換表を引いた回数と見つかった回数
+            int max_reach_ply_ = 0; // 探索で到達した最大の深さ(seldepth)
             int multipv_ = 1, pvIndex_ = 0;
             bool learning_mode_ = false;
+            int learningDepth_ = kMaxPly;
             std::array<StackData, kStackSize> stack_; // 探索スタック
             std::array<MoveScore, 16384> buffer_; // 着手生成用バッファ
             Stats<Score> historyStats_[2]; // ヒストリー
@@ -177,20 +248,19 @@ namespace Trax{
         // 「技巧」より
         class SearchThread {
         public:
-            SearchThread(size_t thread_id, Node& node//, SharedData& shared_data,
+            SearchThread(size_t thread_id//, SharedData& shared_data,
             //ThreadManager& thread_manager
             );
             ~SearchThread();
             void IdleLoop();
-            void SetRootNode(const Node& node);
             void StartSearching();
             void WaitUntilSearchIsFinished();
+            void SetPriority(bool low);
             
             Search search_;
         private:
             //friend class ThreadManager;
             //ThreadManager& thread_manager_;
-            Node& root_node_; // 重いので参照にする
             std::mutex mutex_;
             std::condition_variable sleep_condition_;
             std::atomic_bool searching_, exit_;
@@ -206,21 +276,44 @@ namespace Trax{
             //TimeManager& time_manager() {
             //    return time_manager_;
             //}
+            void ReserveSearchThreads(size_t num_threads);
             void SetNumSearchThreads(size_t num_threads);
+            uint64_t CountNodesSearched() const;
             uint64_t CountNodesSearchedByWorkerThreads() const;
+            void SumSearchStats(const Search& master_search);
             uint64_t CountNodesUnder(Move move) const;
             //RootMove
             //SearchResult
             
-            MoveScoreDepth ParallelSearch(Node& node, //Score draw_score,
+            template<class node_t>
+            MoveScoreDepth ParallelSearch(node_t& node, //Score draw_score,
                                     //const UsiGoOptions& go_options,
                                     const std::vector<Move> searchmoves,
                                     const std::vector<Move> ignoremoves,
                                     int multipv);
+            
+            // 相手手番中の先読み
+            // 呼び出し元は相手の着手を待つので、マスタースレッドの探索も別スレッドで行う
+            template<class node_t>
+            void StartPondering(node_t& node, size_t num_threads, bool low_priority);
+            void FinishPondering();
+            
+            // 今回の探索に参加するワーカースレッドだけを順に処理する
+            template<class callback_t>
+            void ForEachActiveWorker(const callback_t& callback) const {
+                for (size_t i = 0; i < num_active_workers_; ++i) {
+                    callback(*worker_threads_[i]);
+                }
+            }
         //private:
             //SharedData& shared_data_;
             //TimeManager& time_manager_;
             std::vector<std::unique_ptr<SearchThread>> worker_threads_;
+            size_t num_active_workers_ = 0; // 探索に参加するワーカースレッドの数(残りは待機させておく)
+            std::unique_ptr<Search> ponder_search_; // 先読み用マスター探索
+            uint64_t ponder_begin_ = 0; // 先読みを始めた時刻(timeline の時刻)
+            uint64_t master_nodes_ = 0; // 直前の ParallelSearch でマスタースレッドが探索したノード数
+            std::thread ponder_thread_;
         };
         
         struct SearchResult{
@@ -238,19 +331,57 @@ namespace Trax{
         
         KizuNa::ThreadManager manager; // マルチスレッド管理
         HashTable tt; // 置換表
+        EvalHashTable evalHash; // 静的評価点のキャッシュ(全スレッドで共有)
+        int evalHashMegaBytes = 64; // 評価点キャッシュの大きさ
         std::atomic<uint64_t> signals;
         std::array<MoveScore, 16384> buffer; // 着手生成用バッファ(スレッドの準備をせずに使う用)
-        Node node[N_THREADS]; // 各スレッド用の盤面表現 重いのでグローバルに置いておく
-        Board rootBoard; // ルート用盤面
+        Board rootBoard; // ルート用盤面(対局の進行はこの盤面で管理する)
+        NarrowNode node[N_THREADS]; // 各スレッド用の盤面表現 重いのでグローバルに置いておく
+        Node wideNode[N_THREADS]; // 盤面が広がった場合の各スレッド用の盤面表現
+        bool wideSearch = false; // wideNodeで探索するか
+        bool variant8x8 = false; // 8x8 Trax を指すか
+        bool search8x8 = false; // node8x8で探索するか(8x8 Trax でも盤面が 8x8 に収まらなければ通常の盤面で探索する)
+        Node8x8 node8x8[N_THREADS]; // 8x8 Trax 用の各スレッドの盤面表現
         ClockMS clock;
-        //Book book; // 定跡
+        Book book; // 定跡
         bool pondering = true; // 相手手番中の先読みを行うか
-        //std::vector<int> evalParams; // 評価関数パラメータ
+        int numThreads = N_THREADS; // 思考時の探索スレッド数
+        int numPonderThreads = N_THREADS; // 先読み時の探索スレッド数
+        bool lowPonderPriority = false; // 先読み中はスレッドの優先度を下げるか
+        int searchDepthLimit = kMaxPly; // 反復深化の最大深さ(定跡生成など固定深さで探索する場合に制限する)
         //CounterMoveStats counterMoveStats[2]; // 最近見つけた良い応手
         
         constexpr uint64_t SIGNAL_STOP = 1ULL << 63;
         constexpr uint64_t SIGNAL_THREAD_MASK = (1ULL << N_THREADS) - 1ULL;
         
+        TimelineRecorder timeline; // スレッドの動作の記録(開いた時のみ)
+        std::atomic<uint64_t> stopRequestTime(0); // 最後に停止命令を出した時刻(timeline の時刻)
+        std::array<int64_t, N_THREADS> stopLatency; // 停止命令から各スレッドが探索を抜けるまで(マイクロ秒, 停止命令で終わっていなければ -1)
+        bool reportStopLatency = true; // 探索後に停止の遅れを表示するか(固定深さのベンチマークや定跡生成では表示しない)
+        
+        void requestStop(int tid = TimelineRecorder::kMainThread){
+            // 全ての探索スレッドに停止命令を出す
+            stopRequestTime = timeline.now();
+            if(timeline.enabled()){
+                timeline.instant("stop", tid);
+            }
+            signals |= SIGNAL_STOP;
+        }
+        std::string toStopLatencyString(uint64_t searchBegin, uint64_t finishTime){
+            // スレッドごとの停止の遅れと、停止命令から全スレッドを待ち終えるまでの時間
+            // 停止命令がこの探索の開始より前のものなら何も表示しない
+            if(!reportStopLatency || stopRequestTime < searchBegin){ return ""; }
+            std::ostringstream oss;
+            oss << "stop latency :";
+            for(int th = 0; th < N_THREADS; ++th){
+                if(stopLatency[th] >= 0){
+                    oss << " " << th << ":" << stopLatency[th];
+                }
+            }
+            oss << " finish " << (finishTime - stopRequestTime) << " us" << endl;
+            return oss.str();
+        }
+        
         // stats(MINIMUMが付くと集計を止める)
         Counter hashCut("hashCut");
         Counter myMate("myMate");
@@ -258,6 +389,64 @@ namespace Trax{
         Counter oppAttack("oppAtack");
         Counter myDoubleAttacks("doubleAttacks");
         Counter nodes("nodes");
+        Counter evalHashProbes("evalHashProbes");
+        Counter evalHashHits("evalHashHits");
+        Counter ttProbes("ttProbes");
+        Counter ttHits("ttHits");
+        TelemetryWriter telemetry; // 探索の経過の JSON 書き出し(開いた時のみ)
+        Logger logger; // 対局中のログ(クライアントで書き出しスレッドを起動する)
+        bool perfCounting = false; // 探索スレッドごとにハードウェアカウンタで数えるか
+        std::array<PerfCounts, N_THREADS> perfCounts; // 直前の探索のスレッドごとのハードウェアカウンタの値
+        NodeVisitTable *visitTable = nullptr; // スレッド間の重複探索の計測用(計測する時だけ置く)
+#ifdef PROFILE_SEARCH
+        std::array<Analyzer<KizuNa::kNumProfileParts>, N_THREADS> searchProfilers; // 探索の部分ごとの時間
+#endif
+        
+        template<int kSize>
+        bool fitsNarrowNode(const BoardT<kSize>& bd){
+            // 探索の余裕を残して小さい盤面に収まるか
+            constexpr int offset = NARROW_SIZE / 2 - kSize / 2;
+            constexpr int lower = NARROW_MARGIN, upper = NARROW_SIZE - NARROW_MARGIN;
+            return lower <= bd.lx() + offset && bd.hx() + offset < upper
+            && lower <= bd.ly() + offset && bd.hy() + offset < upper;
+        }
+        
+        template<class board_t>
+        bool fits8x8Node(const board_t& bd){
+            // タイルの範囲が 8x8 に収まっていて Board8x8 で表せるか
+            return bd.turn == 0 || (bd.dx() < Board8x8::WIDTH && bd.dy() < Board8x8::WIDTH);
+        }
+        
+        template<class callback_t>
+        auto visitNode(size_t th, const callback_t& f){
+            // 今使っている方の盤面でスレッド th の処理を行う
+            return search8x8 ? f(node8x8[th]) : (wideSearch ? f(wideNode[th]) : f(node[th]));
+        }
+        
+        void syncNodes(){
+            // ルート局面に合わせて探索に使う盤面を選び、各スレッドの盤面を同期する
+            search8x8 = variant8x8;
+            wideSearch = !fitsNarrowNode(rootBoard);
+            for(int th = 0; th < N_THREADS; ++th){
+                if(!visitNode(th, [](auto& nd)->bool{ return nd.syncWith(rootBoard); })){
+                    // 進められない着手があった場合は途中の局面で探索しないよう、ルートと同じ大きさの盤面に切り替える
+                    if(search8x8){
+                        // 8x8 に収まらない局面は Board8x8 で表せないので、通常の盤面で探索する
+                        CERR << "failed to sync the 8x8 board of thread " << th << ", search on the normal board" << endl;
+                        search8x8 = false;
+                        th = -1;
+                        continue;
+                    }
+                    if(wideSearch){
+                        CERR << "failed to sync the board of thread " << th << endl;
+                        break;
+                    }
+                    CERR << "failed to sync the narrow board of thread " << th << ", search on the wide board" << endl;
+                    wideSearch = true;
+                    th = -1;
+                }
+            }
+        }
         
         void initStats(){
             hashCut = 0;
@@ -266,6 +455,17 @@ namespace Trax{
             oppAttack = 0;
             myDoubleAttacks = 0;
             nodes = 0;
+            evalHashProbes = 0;
+            evalHashHits = 0;
+            ttProbes = 0;
+            ttHits = 0;
+            perfCounts.fill(PerfCounts());
+            stopLatency.fill(-1);
+#ifdef PROFILE_SEARCH
+            for(auto& profiler : searchProfilers){
+                profiler.init();
+            }
+#endif
         }
         
         std::string toLineStatsString(){
@@ -277,26 +477,74 @@ namespace Trax{
             std::ostringstream oss;
             oss << "mate = " << myMate << " omate = " << oppMate
             << " oattack = " << oppAttack << " dattacks = " << myDoubleAttacks << endl;
+            oss << "eval hash hit = " << evalHashHits << " / " << evalHashProbes;
+            if(uint64_t(evalHashProbes) > 0){
+                oss << " (" << std::fixed << std::setprecision(1)
+                << 100.0 * uint64_t(evalHashHits) / uint64_t(evalHashProbes) << "%)";
+            }
+            oss << endl;
             return oss.str();
         }
+        std::string toPerfString(){
+            // スレッドごとと合計のハードウェアカウンタの値
+            std::ostringstream oss;
+            PerfCounts total;
+            for(int th = 0; th < N_THREADS; ++th){
+                if(!perfCounts[th].any()){ continue; }
+                oss << "perf thread " << th << " : " << perfCounts[th].toString() << endl;
+                total += perfCounts[th];
+            }
+            if(total.any()){
+                oss << "perf total : " << total.toString() << endl;
+            }else{
+                oss << "perf : no hardware counters available" << endl;
+            }
+            return oss.str();
+        }
+        
+#ifdef PROFILE_SEARCH
+        std::string toProfileString(){
+            // スレッドごとに部分ごとの回数と CPU サイクル数、計測した部分全体に占める割合を出す
+            std::ostringstream oss;
+            for(int th = 0; th < N_THREADS; ++th){
+                const auto& profiler = searchProfilers[th];
+                uint64_t sum = 0;
+                for(int i = 0; i < KizuNa::kNumProfileParts; ++i){
+                    sum += profiler.time[i][0];
+                }
+                if(sum == 0){ continue; }
+                oss << "profile thread " << th << " :";
+                for(int i = 0; i < KizuNa::kNumProfileParts; ++i){
+                    const uint64_t trials = profiler.trials[i], time = profiler.time[i][0];
+                    oss << " " << KizuNa::profilePartNames[i] << " " << trials << " calls "
+                    << (trials > 0 ? time / trials : 0) << " clock/call ("
+                    << std::fixed << std::setprecision(1) << (100.0 * time / sum) << "%)";
+                }
+                oss << endl;
+            }
+            return oss.str();
+        }
+#endif
     }
     
     namespace KizuNa{
-        void ThreadManager::SetNumSearchThreads(size_t num_search_threads) {
-            // 必要なワーカースレッドの数を求める（１を引いているのは、マスタースレッドの分。）
-            size_t num_worker_threads = num_search_threads - 1;
-            
-            // ワーカースレッドを増やす場合
-            while (num_worker_threads > worker_threads_.size()) {
+        void ThreadManager::ReserveSearchThreads(size_t num_search_threads) {
+            // ワーカースレッドを前もって作っておく（１を引いているのは、マスタースレッドの分。）
+            // 思考と先読みでスレッド数が違っても、毎回スレッドを作り直さずに済むようにする
+            num_search_threads = std::max(num_search_threads, size_t(1)); // 0 だと引き算で桁あふれする
+            while (num_search_threads - 1 > worker_threads_.size()) {
                 size_t thread_id = worker_threads_.size() + 1; // ワーカースレッドのIDは1から始める
-                worker_threads_.emplace_back(new SearchThread(thread_id, Global::node[thread_id]/*, shared_data_, *this*/));
-            }
-            
-            // ワーカースレッドを減らす場合
-            while (num_worker_threads < worker_threads_.size()) {
-                worker_threads_.pop_back();
+                worker_threads_.emplace_back(new SearchThread(thread_id/*, shared_data_, *this*/));
             }
         }
+        
+        void ThreadManager::SetNumSearchThreads(size_t num_search_threads) {
+            // 探索に参加させるワーカースレッドの数を決める
+            // 足りなければ作るが、余ったスレッドは消さずに待機させておく
+            num_search_threads = std::max(num_search_threads, size_t(1));
+            ReserveSearchThreads(num_search_threads);
+            num_active_workers_ = num_search_threads - 1;
+        }
     }
 }
 
@@ -306,7 +554,8 @@ namespace Trax{
 namespace Trax{
     namespace KizuNa{
         //SearchResult
-        MoveScoreDepth ThreadManager::ParallelSearch(Node& node,// const Score draw_score,
+        template<class node_t>
+        MoveScoreDepth ThreadManager::ParallelSearch(node_t& node,// const Score draw_score,
                                                      const std::vector<Move> searchmoves,
                                                      const std::vector<Move> ignoremoves,
                                                      const int multipv) {
@@ -316,16 +565,17 @@ namespace Trax{
             //                                                                 node, searchmoves, ignoremoves);
             
             Global::initStats(); // スタッツ初期化
+            const uint64_t search_begin = Global::timeline.now();
             
             // ワーカースレッドの探索を開始する
-            for (std::unique_ptr<SearchThread>& worker : worker_threads_) {
-                //worker->SetRootNode(node);
-                //worker->search_.set_draw_scores(node.side_to_move(), draw_score);
-                //worker->search_.set_root_moves(root_moves);
-                //worker->search_.set_multipv(multipv);
-                //worker->search_.PrepareForNextSearch();
-                worker->StartSearching();
-            }
+            ForEachActiveWorker([](SearchThread& worker)->void{
+                //worker.SetRootNode(node);
+                //worker.search_.set_draw_scores(node.side_to_move(), draw_score);
+                //worker.search_.set_root_moves(root_moves);
+                //worker.search_.set_multipv(multipv);
+                //worker.search_.PrepareForNextSearch();
+                worker.StartSearching();
+            });
             
             // マスタースレッドの探索を開始する
             Search master_search(0/*shared_data_*/);
@@ -336,8 +586,23 @@ namespace Trax{
             MoveScoreDepth best = master_search.iterativeDeepening(node);
             
             // ワーカースレッドの終了を待つ
-            for (std::unique_ptr<SearchThread>& worker : worker_threads_) {
-                worker->WaitUntilSearchIsFinished();
+            const uint64_t wait_begin = Global::timeline.enabled() ? Global::timeline.now() : 0;
+            ForEachActiveWorker([](SearchThread& worker)->void{
+                worker.WaitUntilSearchIsFinished();
+            });
+            if (Global::timeline.enabled()) {
+                Global::timeline.span("wait workers", 0, wait_begin, Global::timeline.now());
+            }
+            master_nodes_ = master_search.nodesSearched();
+            SumSearchStats(master_search);
+            CERR << Global::toFullStatsString();
+#ifdef PROFILE_SEARCH
+            // ワーカーも含めた全スレッドの計測が終わってから表示する
+            CERR << Global::toProfileString();
+#endif
+            CERR << Global::toStopLatencyString(search_begin, Global::timeline.now());
+            if(Global::perfCounting){
+                CERR << Global::toPerfString();
             }
             
             // 最善手と、相手の予想手を取得する
@@ -349,6 +614,73 @@ namespace Trax{
             
             return best;
         }
+        
+        template<class node_t>
+        void ThreadManager::StartPondering(node_t& node, size_t num_threads, bool low_priority){
+            if(ponder_thread_.joinable()){
+                // 前の先読みが終わっていなければ先に止める(動いている std::thread を上書きすると std::terminate になる)
+                FinishPondering();
+                Global::signals = 0;
+            }
+            Global::initStats(); // スタッツ初期化
+            SetNumSearchThreads(num_threads);
+            ponder_begin_ = Global::timeline.now();
+            
+            // ワーカースレッドの探索を開始する
+            ForEachActiveWorker([low_priority](SearchThread& worker)->void{
+                worker.SetPriority(low_priority);
+                worker.StartSearching();
+            });
+            
+            // マスタースレッドの探索を開始する
+            if(!ponder_search_){
+                ponder_search_.reset(new Search(0));
+            }
+            ponder_thread_ = std::thread([this, &node, low_priority](){
+                setCurrentThreadPriority(low_priority);
+                ponder_search_->iterativeDeepening(node);
+            });
+        }
+        
+        void ThreadManager::FinishPondering(){
+            TimelineRecorder& timeline = Global::timeline;
+            const uint64_t finish_begin = timeline.enabled() ? timeline.now() : 0;
+            Global::requestStop(); // stop signal
+            // 優先度を下げたままだと停止命令に気づくのが遅れるので、待つ前に戻しておく
+            ForEachActiveWorker([](SearchThread& worker)->void{
+                worker.SetPriority(false);
+            });
+            if(ponder_thread_.joinable()){
+                ponder_thread_.join();
+            }
+            ForEachActiveWorker([&timeline](SearchThread& worker)->void{
+                const uint64_t wait_begin = timeline.enabled() ? timeline.now() : 0;
+                worker.WaitUntilSearchIsFinished();
+                if (timeline.enabled()) {
+                    timeline.span("wait worker", TimelineRecorder::kMainThread, wait_begin, timeline.now(),
+                                  worker.search_.threadIndex());
+                }
+            });
+            const uint64_t finish_end = timeline.now();
+            if (timeline.enabled()) {
+                timeline.span("ponder", TimelineRecorder::kMainThread, ponder_begin_, finish_begin);
+                timeline.span("finish pondering", TimelineRecorder::kMainThread, finish_begin, finish_end);
+            }
+            if(ponder_search_){
+                SumSearchStats(*ponder_search_);
+                CERR << "ponder " << Global::toFullStatsString();
+            }
+#ifdef PROFILE_SEARCH
+            CERR << "ponder " << Global::toProfileString();
+#endif
+            const std::string stop_latency = Global::toStopLatencyString(ponder_begin_, finish_end);
+            if(!stop_latency.empty()){
+                CERR << "ponder " << stop_latency;
+            }
+            if(Global::perfCounting){
+                CERR << "ponder " << Global::toPerfString();
+            }
+        }
     }
 }
 
@@ -0,0 +1,172 @@
+/*
+ learn.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_LEARN_HPP_
+#define TRAX_LEARN_HPP_
+
+#include <mutex>
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "params.hpp"
+
+namespace Trax{
+    
+    /**************************学習用局面**************************/
+    
+    // 自己対戦で生成する学習用局面ファイルの形式(リトルエンディアン)
+    //   TeacherHeader
+    //   { TeacherPosition, TeacherFeature * features } * 局面数
+    // 特徴量は評価関数パラメータ(eval_params)の添字とその出現数の疎ベクトルで、手番側から見て数える
+    //   0, 1     : threats (手番側, 相手側)
+    //   2, 3     : longLines (手番側, 相手側)
+    //   4 ~      : 線割 (4 + 形 * 2 + 相手の色か)
+    //   516 ~    : 2線関係 (516 + 形 * 2 + 相手の色か)
+    //   1028     : 定数項(特徴量としては持たない)
+    
+    constexpr int kEvalParamBias = 1028;
+    
+    struct TeacherHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+    
+    struct TeacherPosition{
+        int16_t score; // 探索の点(手番側から見る)
+        int8_t result; // 手番側から見た対局結果 (+1 勝ち, 0 引き分け, -1 負け)
+        uint8_t turn; // 手数
+        uint16_t features; // 続く特徴量の数
+        uint16_t reserved;
+    };
+    
+    struct TeacherFeature{
+        uint16_t index;
+        int16_t count;
+    };
+    
+    static_assert(sizeof(TeacherHeader) == 16, "");
+    static_assert(sizeof(TeacherPosition) == 8, "");
+    static_assert(sizeof(TeacherFeature) == 4, "");
+    
+    constexpr char kTeacherMagic[8] = {'K', 'Z', 'N', 'T', 'C', 'H', 'R', '\0'};
+    constexpr uint32_t kTeacherVersion = 1;
+    
+    template<class board_t, class features_t>
+    void extractFeatures(board_t& bd, features_t *const pfv){
+        // 評価関数と同じ特徴量を疎ベクトルで取り出す
+        // 試合終了していない局面のみ
+        EvalFeatures ef;
+        ef.clear();
+        bd.updateEvalInfo(&ef);
+        const Color myColor = bd.turnColor();
+        const Color oppColor = flipColor(myColor);
+        auto add = [pfv](int index, int count)->void{
+            if(count != 0){
+                pfv->push_back(TeacherFeature{static_cast<uint16_t>(index), static_cast<int16_t>(count)});
+            }
+        };
+        add(0, bd.threats[myColor]);
+        add(1, bd.threats[oppColor]);
+        add(2, bd.longLines[myColor]);
+        add(3, bd.longLines[oppColor]);
+        for(int c = 0; c < 2; ++c){
+            const int opp = int(c != myColor);
+            for(int i = 0; i < 256; ++i){
+                add(4 + i * 2 + opp, ef.lineShape[c][i]);
+            }
+        }
+        for(int c = 0; c < 2; ++c){
+            const int opp = int(c != myColor);
+            for(int i = 0; i < 256; ++i){
+                add(516 + i * 2 + opp, ef.twoLinesFrontShape[c][i]);
+            }
+        }
+    }
+    
+    template<class params_t>
+    int evaluateFeatures(const TeacherFeature *const features, int n, const params_t& params){
+        // 疎ベクトルでの評価(TraxNode::evaluate() と一致する)
+        int s = params[kEvalParamBias];
+        for(int i = 0; i < n; ++i){
+            s += params[features[i].index] * features[i].count;
+        }
+        return s;
+    }
+    
+    struct TeacherData{
+        // 読み込んだ学習用局面
+        // i 番目の局面の特徴量は features[offsets[i]] から positions[i].features 個
+        std::vector<TeacherPosition> positions;
+        std::vector<uint64_t> offsets;
+        std::vector<TeacherFeature> features;
+        
+        size_t size()const noexcept{ return positions.size(); }
+        const TeacherFeature* featuresOf(size_t i)const noexcept{ return features.data() + offsets[i]; }
+    };
+    
+    bool loadTeacherFile(const std::string& path, TeacherData *const pdata){
+        // ファイルの局面を pdata に追加する
+        std::ifstream ifs(path, std::ios::binary);
+        if(!ifs){ return false; }
+        const std::vector<char> buffer((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        const TeacherHeader *const header = reinterpret_cast<const TeacherHeader*>(buffer.data());
+        if(buffer.size() < sizeof(TeacherHeader)
+           || memcmp(header->magic, kTeacherMagic, sizeof(kTeacherMagic)) || header->version != kTeacherVersion){
+            cerr << "loadTeacherFile() : broken teacher file " << path << endl;
+            return false;
+        }
+        size_t p = sizeof(TeacherHeader);
+        while(p + sizeof(TeacherPosition) <= buffer.size()){
+            TeacherPosition pos;
+            memcpy(&pos, buffer.data() + p, sizeof(pos));
+            const size_t next = p + sizeof(pos) + pos.features * sizeof(TeacherFeature);
+            if(next > buffer.size()){ break; } // 書きかけの局面
+            pdata->positions.push_back(pos);
+            pdata->offsets.push_back(pdata->features.size());
+            const size_t first = pdata->features.size();
+            pdata->features.resize(first + pos.features);
+            memcpy(pdata->features.data() + first, buffer.data() + p + sizeof(pos), pos.features * sizeof(TeacherFeature));
+            p = next;
+        }
+        return true;
+    }
+    
+    class TeacherWriter{
+        // 学習用局面をまとめて書き出す
+        // 複数スレッドから呼ぶ場合は、スレッドごとのバッファに append() で溜めて write() でまとめて書く
+    public:
+        bool open(const std::string& path){
+            ofs_.open(path, std::ios::binary | std::ios::app);
+            if(!ofs_){ return false; }
+            if(ofs_.tellp() == 0){
+                TeacherHeader header;
+                memcpy(header.magic, kTeacherMagic, sizeof(kTeacherMagic));
+                header.version = kTeacherVersion;
+                header.reserved = 0;
+                ofs_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            }
+            return bool(ofs_);
+        }
+        void write(const std::vector<char>& buffer){
+            std::lock_guard<std::mutex> lock(mutex_);
+            ofs_.write(buffer.data(), buffer.size());
+        }
+        void close(){ ofs_.close(); }
+        
+        static void append(std::vector<char> *const pbuffer, const TeacherPosition& pos, const TeacherFeature *const features){
+            const char *const p = reinterpret_cast<const char*>(&pos);
+            pbuffer->insert(pbuffer->end(), p, p + sizeof(pos));
+            const char *const q = reinterpret_cast<const char*>(features);
+            pbuffer->insert(pbuffer->end(), q, q + pos.features * sizeof(TeacherFeature));
+        }
+    
+    private:
+        std::ofstream ofs_;
+        std::mutex mutex_;
+    };
+}
+
+#endif // TRAX_LEARN_HPP_
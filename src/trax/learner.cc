@@ -0,0 +1,290 @@
+/*
+ learner.cc
+ Katsuki Ohto
+ */
+
+// 評価関数パラメータの学習
+// 自己対戦の学習用局面(learn.hpp)から、評価値をシグモイドで勝率に変換したロジスティック回帰を
+// ミニバッチ勾配法(Adam)で最適化し、エンジンが読む形式(params.hpp)で書き出す
+// 目標値は対局結果と探索の点の勝率を lambda で混ぜたもの
+// 勾配はバッチをスレッドで分けて各スレッドの密な配列に足し、最後にまとめる
+// ワーカースレッドは最初に立ち上げて、全エポックのミニバッチで使い回す
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "learn.hpp"
+
+using namespace Trax;
+
+// 密な配列の長さ(ベクトル化しやすいように16の倍数にする)
+constexpr int kWeights = (kNumEvalParams + 15) / 16 * 16;
+
+struct alignas(64) WeightVector{
+    std::array<float, kWeights> v;
+    
+    void clear()noexcept{ v.fill(0); }
+    float& operator[](int i)noexcept{ return v[i]; }
+    float operator[](int i)const noexcept{ return v[i]; }
+};
+
+struct Learner{
+    const TeacherData& data;
+    std::vector<float> targets; // 局面ごとの目標勝率
+    
+    WeightVector w, m, v; // パラメータと Adam のモーメント
+    std::vector<WeightVector> grads; // スレッドごとの勾配
+    int numThreads;
+    double scale; // 評価値を勝率に変換する時の尺度
+    double learningRate, l2;
+    int steps = 0;
+    
+    // ワーカースレッド(スレッド 0 の分は step を呼んだスレッドが計算する)
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition, finishCondition;
+    uint64_t generation = 0; // 配ったミニバッチの番号
+    int running = 0; // 計算中のワーカーの数
+    bool exiting = false;
+    const size_t *batchIndices = nullptr;
+    size_t batchSize = 0;
+    std::vector<double> losses; // スレッドごとの損失
+    
+    Learner(const TeacherData& adata, int threads, double ascale, double lambda, double alr, double al2):
+    data(adata), grads(threads), numThreads(threads), scale(ascale), learningRate(alr), l2(al2), losses(threads, 0){
+        w.clear(); m.clear(); v.clear();
+        for(int i = 0; i < kNumEvalParams; ++i){
+            w[i] = evalParams[i];
+        }
+        targets.resize(data.size());
+        for(size_t i = 0; i < data.size(); ++i){
+            const TeacherPosition& pos = data.positions[i];
+            const double result = (pos.result + 1) / 2.0;
+            targets[i] = static_cast<float>(lambda * result + (1 - lambda) * sigmoid(pos.score, scale));
+        }
+        for(int th = 1; th < numThreads; ++th){
+            workers.emplace_back([this, th]()->void{ workerLoop(th); });
+        }
+    }
+    ~Learner(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exiting = true;
+        }
+        startCondition.notify_all();
+        for(std::thread& t : workers){ t.join(); }
+    }
+    
+    void workerLoop(int th){
+        // 新しいミニバッチが配られるのを待って自分の分の勾配を計算する
+        uint64_t done = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [this, done]()->bool{ return exiting || generation != done; });
+                if(exiting){ return; }
+                done = generation;
+            }
+            accumulateChunk(th);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running -= 1;
+            }
+            finishCondition.notify_one();
+        }
+    }
+    
+    double predict(size_t i)const{
+        // 疎ベクトルと密なパラメータの内積
+        const TeacherFeature *const f = data.featuresOf(i);
+        const int n = data.positions[i].features;
+        float s = w[kEvalParamBias];
+        for(int k = 0; k < n; ++k){
+            s += w[f[k].index] * f[k].count;
+        }
+        return s;
+    }
+    
+    double accumulate(const size_t *const indices, size_t n, WeightVector *const pg)const{
+        // 交差エントロピー損失の和を返し、勾配を pg に足す
+        double loss = 0;
+        for(size_t j = 0; j < n; ++j){
+            const size_t i = indices[j];
+            const double p = sigmoid(predict(i), scale);
+            const double t = targets[i];
+            loss -= t * std::log(max(p, 1e-12)) + (1 - t) * std::log(max(1 - p, 1e-12));
+            const float g = static_cast<float>((p - t) / scale);
+            const TeacherFeature *const f = data.featuresOf(i);
+            const int nf = data.positions[i].features;
+            for(int k = 0; k < nf; ++k){
+                (*pg)[f[k].index] += g * f[k].count;
+            }
+            (*pg)[kEvalParamBias] += g;
+        }
+        return loss;
+    }
+    
+    void accumulateChunk(int th){
+        // 配られたミニバッチのうちスレッド th の分
+        const size_t n = batchSize;
+        const size_t chunk = (n + numThreads - 1) / numThreads;
+        const size_t begin = min(n, th * chunk), end = min(n, begin + chunk);
+        grads[th].clear();
+        losses[th] = accumulate(batchIndices + begin, end - begin, &grads[th]);
+    }
+    
+    double step(const size_t *const indices, size_t n){
+        // 1ミニバッチ分の更新
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batchIndices = indices;
+            batchSize = n;
+            running = numThreads - 1;
+            generation += 1;
+        }
+        startCondition.notify_all();
+        accumulateChunk(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finishCondition.wait(lock, [this]()->bool{ return running == 0; });
+        }
+        for(int th = 1; th < numThreads; ++th){
+            for(int i = 0; i < kWeights; ++i){ // ベクトル化される
+                grads[0][i] += grads[th][i];
+            }
+        }
+        
+        // Adam
+        constexpr float beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+        steps += 1;
+        const float c1 = 1 - std::pow(beta1, steps), c2 = 1 - std::pow(beta2, steps);
+        const float lr = learningRate, decay = l2, inv = 1.0f / n;
+        WeightVector& g = grads[0];
+        for(int i = 0; i < kWeights; ++i){ // ベクトル化される
+            const float gi = g[i] * inv + (i == kEvalParamBias ? 0.0f : decay * w[i]);
+            m[i] = beta1 * m[i] + (1 - beta1) * gi;
+            v[i] = beta2 * v[i] + (1 - beta2) * gi * gi;
+            w[i] -= lr * (m[i] / c1) / (std::sqrt(v[i] / c2) + eps);
+        }
+        return std::accumulate(losses.begin(), losses.end(), 0.0);
+    }
+    
+    double loss(const size_t *const indices, size_t n){
+        // 更新せずに損失だけ求める
+        double sum = 0;
+        for(size_t j = 0; j < n; ++j){
+            const size_t i = indices[j];
+            const double p = sigmoid(predict(i), scale);
+            const double t = targets[i];
+            sum -= t * std::log(max(p, 1e-12)) + (1 - t) * std::log(max(1 - p, 1e-12));
+        }
+        return n > 0 ? sum / n : 0;
+    }
+};
+
+int main(int argc, char* argv[]){
+    
+    setvbuf(stdout, NULL, _IONBF, 0);
+    
+    std::vector<std::string> teacherFilePaths;
+    std::string outputFilePath = "./data/eval_params.dat";
+    int epochs = 10;
+    size_t batchSize = 16384;
+    int numThreads = std::thread::hardware_concurrency();
+    double scale = 400; // 評価値 scale で勝率約 73%
+    double lambda = 0.5; // 目標値での対局結果の割合
+    double learningRate = 2.0;
+    double l2 = 1e-4;
+    double validationRate = 0.05;
+    uint64_t seed = time(NULL);
+    
+    for(int c = 1; c < argc; ++c){
+        if(!strcmp(argv[c], "-i")){
+            teacherFilePaths.push_back(std::string(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-o")){
+            outputFilePath = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-e")){
+            epochs = max(0, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-b")){
+            batchSize = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-th")){
+            numThreads = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-scale")){
+            scale = max(1.0, atof(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-l")){
+            lambda = max(0.0, min(atof(argv[c + 1]), 1.0));
+        }else if(!strcmp(argv[c], "-lr")){
+            learningRate = atof(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-l2")){
+            l2 = atof(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-v")){
+            validationRate = max(0.0, min(atof(argv[c + 1]), 0.5));
+        }else if(!strcmp(argv[c], "-s")){
+            seed = strtoull(argv[c + 1], nullptr, 10);
+        }else if(!strcmp(argv[c], "-pi")){
+            if(!evalParams.load(argv[c + 1])){
+                cerr << "failed to load evaluation parameters " << argv[c + 1] << endl;
+                return 1;
+            }
+        }
+    }
+    numThreads = max(1, numThreads);
+    if(teacherFilePaths.empty()){
+        teacherFilePaths.push_back("./data/teacher.bin");
+    }
+    
+    // 学習用局面を読み込む
+    ClockMS clock;
+    clock.start();
+    TeacherData data;
+    for(const std::string& path : teacherFilePaths){
+        if(!loadTeacherFile(path, &data)){
+            cerr << "failed to load " << path << endl;
+            return 1;
+        }
+    }
+    cerr << "loaded " << data.size() << " positions (" << data.features.size() << " features) in " << clock.stop() << " ms" << endl;
+    
+    // 詰みの点の局面は勝率に意味が無いので除く
+    std::vector<size_t> indices;
+    for(size_t i = 0; i < data.size(); ++i){
+        if(abs(data.positions[i].score) < kScoreAlmostWin){
+            indices.push_back(i);
+        }
+    }
+    XorShift64 dice;
+    dice.srand(seed);
+    for(size_t i = indices.size(); i > 1; --i){
+        std::swap(indices[i - 1], indices[dice.rand() % i]);
+    }
+    const size_t numValidation = indices.size() * validationRate;
+    const size_t numTraining = indices.size() - numValidation;
+    if(numTraining == 0){
+        cerr << "no positions to learn." << endl;
+        return 1;
+    }
+    cerr << numTraining << " training, " << numValidation << " validation positions" << endl;
+    
+    Learner learner(data, numThreads, scale, lambda, learningRate, l2);
+    cerr << "epoch 0 validation loss = " << learner.loss(indices.data() + numTraining, numValidation) << endl;
+    for(int e = 0; e < epochs; ++e){
+        clock.start();
+        for(size_t i = numTraining; i > 1; --i){
+            std::swap(indices[i - 1], indices[dice.rand() % i]);
+        }
+        double sum = 0;
+        for(size_t b = 0; b < numTraining; b += batchSize){
+            sum += learner.step(indices.data() + b, min(batchSize, numTraining - b));
+        }
+        cerr << "epoch " << (e + 1) << " training loss = " << (sum / numTraining)
+        << " validation loss = " << learner.loss(indices.data() + numTraining, numValidation)
+        << " (" << clock.stop() << " ms)" << endl;
+    }
+    
+    if(!EvalParams::write(outputFilePath, learner.w.v.data())){
+        cerr << "failed to write " << outputFilePath << endl;
+        return 1;
+    }
+    cerr << "wrote " << outputFilePath << endl;
+    
+    return 0;
+}
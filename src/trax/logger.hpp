@@ -0,0 +1,225 @@
+/*
+ logger.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_LOGGER_HPP_
+#define TRAX_LOGGER_HPP_
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <streambuf>
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************非同期ログ**************************/
+    
+    // 対局中のログ(標準エラー出力、通信ログ、エラーログ)を書き出す
+    // 書く側はロックを取らないリングバッファに積むだけで、ファイルや端末への出力は専用のスレッドが行う
+    // 通信の応答時間にファイルや端末の入出力の時間が入らないようにするため
+    // バッファが満杯の時は待たずにメッセージを捨てて数える
+    
+    enum LogLevel{
+        kLogDebug, kLogInfo, kLogWarning, kLogError,
+    };
+    
+    enum LogSink{
+        kLogStderr, // 標準エラー出力(警告以上はエラーログにも書く)
+        kLogCommunication, // 通信ログ
+    };
+    
+    class Logger{
+    public:
+        static constexpr size_t kCapacity = 4096;
+        
+        bool start(const std::string& communicationPath, const std::string& errorPath){
+            // ファイルを開いて書き出しスレッドを起動する
+            stop();
+            communication_.open(communicationPath, std::ios::app);
+            error_.open(errorPath, std::ios::app);
+            exit_ = false;
+            running_ = true;
+            thread_ = std::thread([this]()->void{ flushLoop(); });
+            return communication_ && error_;
+        }
+        void stop(){
+            // 積まれているメッセージを書き終えてから止める
+            if(!running_){ return; }
+            restore();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                exit_ = true;
+                condition_.notify_one();
+            }
+            thread_.join();
+            running_ = false;
+            // バッファが満杯で捨てたメッセージがあれば最後に知らせる
+            const uint64_t dropped = dropped_;
+            if(dropped > 0){
+                write(kLogWarning, kLogStderr, "logger dropped " + std::to_string(dropped) + " messages\n");
+            }
+            communication_.close();
+            error_.close();
+        }
+        
+        void setLevel(LogLevel level)noexcept{ level_ = level; }
+        bool enabled(LogLevel level)const noexcept{ return level >= level_; }
+        uint64_t dropped()const noexcept{ return dropped_; }
+        
+        bool push(LogLevel level, LogSink sink, std::string&& text){
+            if(sink == kLogStderr && !enabled(level)){ return true; }
+            if(!running_){ // 書き出しスレッドを起動する前はその場で書く
+                write(level, sink, text);
+                return true;
+            }
+            // 複数の書き手から1つの読み手へのキュー(各枠の通し番号で空きと書き込み済みを区別する)
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            Slot *ps;
+            while(true){
+                ps = &slots_[pos % kCapacity];
+                const int64_t diff = int64_t(ps->sequence.load(std::memory_order_acquire)) - int64_t(pos);
+                if(diff == 0){
+                    if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){ break; }
+                }else if(diff < 0){ // 満杯
+                    dropped_ += 1;
+                    return false;
+                }else{
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+            ps->level = level;
+            ps->sink = sink;
+            ps->text = std::move(text);
+            ps->sequence.store(pos + 1, std::memory_order_release);
+            condition_.notify_one(); // ロックは取らない(取りこぼしても書き出しスレッドは一定時間で起きる)
+            return true;
+        }
+        
+        void redirect(std::ostream& os){
+            // 既存の CERR 出力も1行ずつ標準エラー出力のメッセージとして積むようにする
+            restore();
+            // 書き出しスレッドが元の出力先を読むので、付け替える前に入れておく
+            original_ = os.rdbuf();
+            os.rdbuf(&streamBuf_);
+            redirected_ = &os;
+        }
+        
+        Logger():
+        streamBuf_(this){
+            for(size_t i = 0; i < kCapacity; ++i){
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        ~Logger(){ stop(); }
+    
+    private:
+        struct Slot{
+            std::atomic<uint64_t> sequence;
+            LogLevel level;
+            LogSink sink;
+            std::string text;
+        };
+        
+        class StreamBuf : public std::streambuf{
+            // スレッドごとに1行ためて、改行ごとに情報レベルのメッセージとして積む
+        public:
+            explicit StreamBuf(Logger *const plogger): plogger_(plogger){}
+        protected:
+            int overflow(int c)override{
+                if(c != traits_type::eof()){
+                    const char ch = static_cast<char>(c);
+                    xsputn(&ch, 1);
+                }
+                return c;
+            }
+            std::streamsize xsputn(const char *s, std::streamsize n)override{
+                std::string& line = threadLine();
+                for(std::streamsize i = 0; i < n; ++i){
+                    line += s[i];
+                    if(s[i] == '\n'){
+                        plogger_->push(kLogInfo, kLogStderr, std::move(line));
+                        line.clear();
+                    }
+                }
+                return n;
+            }
+        private:
+            static std::string& threadLine(){
+                static thread_local std::string line;
+                return line;
+            }
+            Logger *const plogger_;
+        };
+        
+        void restore(){
+            if(redirected_ != nullptr){
+                redirected_->rdbuf(original_.load());
+                redirected_ = nullptr;
+            }
+        }
+        
+        void write(LogLevel level, LogSink sink, const std::string& text){
+            if(sink == kLogCommunication){
+                communication_ << getpid() << " " << text; // プロセスID付きでログを残す
+                return;
+            }
+            std::streambuf *const original = original_;
+            std::ostream err(original != nullptr ? original : std::cerr.rdbuf());
+            err << text;
+            if(level >= kLogWarning && error_.is_open()){
+                error_ << getpid() << " " << text;
+            }
+        }
+        
+        void flushLoop(){
+            while(true){
+                bool exiting;
+                {
+                    // 終了命令より前に積まれたメッセージは書き終えてから抜ける
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    exiting = exit_;
+                }
+                bool written = false;
+                while(true){
+                    Slot& s = slots_[head_ % kCapacity];
+                    if(s.sequence.load(std::memory_order_acquire) != head_ + 1){ break; }
+                    write(s.level, s.sink, s.text);
+                    s.text.clear();
+                    s.sequence.store(head_ + kCapacity, std::memory_order_release);
+                    head_ += 1;
+                    written = true;
+                }
+                if(written){
+                    communication_.flush();
+                    error_.flush();
+                    continue;
+                }
+                if(exiting){ break; }
+                std::unique_lock<std::mutex> lock(mutex_);
+                if(!exit_){
+                    condition_.wait_for(lock, std::chrono::milliseconds(20));
+                }
+            }
+        }
+        
+        std::array<Slot, kCapacity> slots_;
+        std::atomic<uint64_t> tail_{0};
+        uint64_t head_ = 0; // 読み手は書き出しスレッドのみ
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<LogLevel> level_{kLogInfo};
+        std::atomic<bool> running_{false};
+        bool exit_ = false;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::thread thread_;
+        std::ofstream communication_, error_;
+        StreamBuf streamBuf_;
+        std::atomic<std::streambuf*> original_{nullptr}; // 書き出しスレッドの起動後に redirect されることがある
+        std::ostream *redirected_ = nullptr;
+    };
+}
+
+#endif // TRAX_LOGGER_HPP_
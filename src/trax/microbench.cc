@@ -0,0 +1,219 @@
+/*
+ microbench.cc
+ Katsuki Ohto
+ */
+
+// 盤面の基本操作ごとの速度計測
+// ベンチマーク局面集(bench.hpp)を手数で序盤、中盤、終盤に分け、
+// 各操作をその局面で順番に繰り返して 1 回あたりの時間(ns)と CPU サイクル数を出す
+// 置換表はキャッシュに載らない大きさの表をランダムなキーで引く
+// -8 を付けると 8x8 に収まる局面だけで、通常の盤面と Board8x8 の両方を計測する
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "kizuna.h"
+
+uint64_t LIMIT_TIME = -1;
+
+#include "search.hpp"
+#include "bench.hpp"
+
+using namespace Trax;
+
+template<class board_t>
+struct BenchPosition{
+    std::unique_ptr<board_t> pbd; // 盤面は大きいのでヒープに置く
+    std::vector<Move> moves; // 合法手
+    std::vector<std::string> notations; // 合法手の棋譜表記
+};
+
+template<class board_t>
+struct Phase{
+    const char *name;
+    int minTurn, maxTurn;
+    std::vector<BenchPosition<board_t>> positions;
+};
+
+uint64_t sink = 0; // 計測する処理が消されないように結果を足しておく
+long minTimeMs = 200; // 1つの計測の最小時間
+std::string filter; // 名前にこれを含む計測だけ行う
+
+template<class callback_t>
+void measure(const std::string& name, const char *phase, const callback_t& callback){
+    // 回数を倍々にして、最小時間を超えた時の 1 回あたりの時間を出す
+    if(!filter.empty() && name.find(filter) == std::string::npos){ return; }
+    for(uint64_t i = 0; i < 1024; ++i){ callback(i); } // ウォームアップ
+    for(uint64_t ops = 1024;; ops *= 2){
+        ClockMicS clock;
+        Clock cycles;
+        clock.start();
+        cycles.start();
+        for(uint64_t i = 0; i < ops; ++i){
+            callback(i);
+        }
+        const uint64_t c = cycles.stop();
+        const long us = clock.stop();
+        if(us >= minTimeMs * 1000){
+            cout << std::left << std::setw(32) << name << std::setw(8) << phase << std::right
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << (us * 1000.0 / ops) << " ns/op"
+            << std::setw(12) << (double(c) / ops) << " cycles/op" << endl;
+            return;
+        }
+    }
+}
+
+template<class board_t>
+void benchPhase(Phase<board_t>& phase, const std::string& prefix){
+    std::vector<BenchPosition<board_t>>& positions = phase.positions;
+    const size_t n = positions.size();
+    if(n == 0){ return; }
+    
+    measure(prefix + "makeMove+unmakeMove", phase.name, [&](uint64_t i)->void{
+        BenchPosition<board_t>& pos = positions[i % n];
+        board_t& bd = *pos.pbd;
+        const Move mv = pos.moves[(i / n) % pos.moves.size()];
+        const int ret = bd.template makeMove<true>(mv);
+        if(ret >= 0){ bd.template unmakeMove<true>(); }
+        sink += ret;
+    });
+    measure(prefix + "checkSetAttacks", phase.name, [&](uint64_t i)->void{
+        board_t& bd = *positions[i % n].pbd;
+        bd.checkSetAttacks();
+        sink += bd.attacks[0];
+    });
+    measure(prefix + "hasInevasibleAttacks", phase.name, [&](uint64_t i)->void{
+        const board_t& bd = *positions[i % n].pbd;
+        sink += bd.hasInevasibleAttacks(static_cast<Color>((i / n) & 1));
+    });
+    measure(prefix + "updateEvalInfo", phase.name, [&](uint64_t i)->void{
+        board_t& bd = *positions[i % n].pbd;
+        bd.updateEvalInfo();
+        sink += bd.threats[0];
+    });
+    measure(prefix + "calcRepRelativeHash", phase.name, [&](uint64_t i)->void{
+        const board_t& bd = *positions[i % n].pbd;
+        int pattern;
+        sink ^= calcRepRelativeHash(bd, pattern);
+    });
+    measure(prefix + "generateNewerLineMoves", phase.name, [&](uint64_t i)->void{
+        const board_t& bd = *positions[i % n].pbd;
+        Move buffer[1024];
+        sink += generateNewerLineMoves(buffer, bd);
+    });
+    measure(prefix + "readMoveNotation", phase.name, [&](uint64_t i)->void{
+        const BenchPosition<board_t>& pos = positions[i % n];
+        const Move mv = readMoveNotation(pos.notations[(i / n) % pos.notations.size()], *pos.pbd);
+        sink += mv.z();
+    });
+}
+
+template<class board_t>
+void loadPhases(std::vector<Phase<board_t>> *const pphases, bool only8x8){
+    // ベンチマーク局面集を手数で序盤、中盤、終盤に分ける
+    // only8x8 ならタイルの範囲が 8x8 に収まる局面だけを使う
+    std::vector<Phase<board_t>>& phases = *pphases;
+    phases.resize(3);
+    phases[0].name = "early"; phases[0].minTurn = 0; phases[0].maxTurn = 12;
+    phases[1].name = "mid"; phases[1].minTurn = 13; phases[1].maxTurn = 24;
+    phases[2].name = "late"; phases[2].minTurn = 25; phases[2].maxTurn = N_TURNS;
+    for(const std::string& record : benchRecords){
+        BenchPosition<board_t> pos;
+        pos.pbd.reset(new board_t);
+        board_t& bd = *pos.pbd;
+        bd.clear();
+        int ret = 0;
+        for(const std::string& str : split(record, ' ')){
+            const Move mv = readMoveNotation(str, bd);
+            ret = (mv == kMoveNone) ? -1 : bd.makeMove(mv);
+            if(ret != 0){ break; }
+        }
+        if(ret != 0){ continue; }
+        if(only8x8 && !Global::fits8x8Node(bd)){ continue; }
+        bd.checkSetAttacks();
+        pos.moves = generateMoveVector<Move, true>(bd);
+        if(pos.moves.empty()){ continue; }
+        for(const Move& mv : pos.moves){
+            pos.notations.push_back(toNotationString(mv, bd));
+        }
+        for(Phase<board_t>& phase : phases){
+            if(phase.minTurn <= bd.turn && bd.turn <= phase.maxTurn){
+                phase.positions.push_back(std::move(pos));
+                break;
+            }
+        }
+    }
+    cout << "positions :";
+    for(const Phase<board_t>& phase : phases){
+        cout << " " << phase.name << " " << phase.positions.size();
+    }
+    cout << endl;
+}
+
+void benchHashTable(size_t megabytes){
+    // 探索の置換表と同じ大きさの表を、あらかじめ作ったランダムなキーで引く
+    std::unique_ptr<HashTable> ptable(new HashTable);
+    HashTable& table = *ptable;
+    table.SetSize(megabytes);
+    XorShift64 dice;
+    dice.srand(1);
+    std::vector<uint64_t> keys(1 << 20);
+    for(uint64_t& key : keys){ key = dice.rand(); }
+    const size_t mask = keys.size() - 1;
+    const std::string size = std::to_string(megabytes) + "MB";
+    
+    measure("HashTable::Save", size.c_str(), [&](uint64_t i)->void{
+        table.Save(keys[i & mask], kMoveNone, Score(int(i & 255)), Depth(int(i & 15)), kBoundExact, kScoreNone, false);
+    });
+    measure("HashTable::LookUp(hit)", size.c_str(), [&](uint64_t i)->void{
+        const HashEntry *const pe = table.LookUp(keys[i & mask]);
+        sink += (pe != nullptr);
+    });
+    measure("HashTable::LookUp(miss)", size.c_str(), [&](uint64_t i)->void{
+        const HashEntry *const pe = table.LookUp(~keys[i & mask]);
+        sink += (pe != nullptr);
+    });
+}
+
+int main(int argc, char* argv[]){
+    
+    setvbuf(stdout, NULL, _IONBF, 0);
+    
+    size_t hashMegaBytes = 1024;
+    bool compare8x8 = false;
+    
+    for(int c = 1; c < argc; ++c){
+        if(!strcmp(argv[c], "-t")){
+            minTimeMs = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-f")){
+            filter = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-8")){
+            compare8x8 = true;
+        }else if(!strcmp(argv[c], "-hash")){
+            hashMegaBytes = max(1, atoi(argv[c + 1]));
+        }
+    }
+    
+    Trax::initTrax();
+    
+    if(!compare8x8){
+        std::vector<Phase<Board>> phases;
+        loadPhases(&phases, false);
+        for(Phase<Board>& phase : phases){
+            benchPhase(phase, "");
+        }
+    }else{
+        std::vector<Phase<Board>> phases;
+        std::vector<Phase<Board8x8>> phases8x8;
+        loadPhases(&phases, true);
+        loadPhases(&phases8x8, true);
+        for(size_t i = 0; i < phases.size(); ++i){
+            benchPhase(phases[i], "normal ");
+            benchPhase(phases8x8[i], "8x8 ");
+        }
+    }
+    benchHashTable(hashMegaBytes);
+    cerr << "(" << sink << ")" << endl;
+    
+    return 0;
+}
@@ -28,7 +28,7 @@ namespace Trax{
         Score evaluate(const Color myColor){
             // ヌルムーブ枝刈りのために相手の色でも呼べるように色を引数に持つ
             // 手番を持つ(次にプレーする)プレーヤーをmyColorとする
-            const int *const params = eval_params;
+            const EvalParams& params = evalParams;
             //board_t::updateEvalInfo(params);
             board_t::updateEvalInfo();
             
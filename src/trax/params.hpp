@@ -0,0 +1,120 @@
+/*
+ params.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_PARAMS_HPP_
+#define TRAX_PARAMS_HPP_
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "eval_params.h"
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************評価関数パラメータ**************************/
+    
+    // パラメータファイルの形式(リトルエンディアン)
+    //   EvalParamsHeader
+    //   int16_t * params
+    // 読めなかった場合は eval_params.h に埋め込まれた値を使う
+    
+    constexpr int kNumEvalParams = sizeof(eval_params) / sizeof(eval_params[0]);
+    
+    struct EvalParamsHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t params;
+        uint64_t reserved;
+    };
+    
+    static_assert(sizeof(EvalParamsHeader) == 24, "");
+    
+    class EvalParams{
+    public:
+        static constexpr char kMagic[8] = {'K', 'Z', 'N', 'E', 'V', 'A', 'L', '\0'};
+        static constexpr uint32_t kVersion = 1;
+        
+        int operator[](int i)const noexcept{ return values_[i]; }
+        const int16_t* data()const noexcept{ return values_.data(); }
+        static constexpr int size()noexcept{ return kNumEvalParams; }
+        
+        void setDefault(){
+            for(int i = 0; i < kNumEvalParams; ++i){
+                values_[i] = static_cast<int16_t>(eval_params[i]);
+            }
+        }
+        
+        bool load(const std::string& path){
+            // ファイルをマップして検査した上で取り込む
+            // 探索中に呼ぶと評価が混ざるので、対局と対局の間でのみ呼ぶこと
+#ifdef _WIN32
+            std::ifstream ifs(path, std::ios::binary);
+            if(!ifs){ return false; }
+            const std::vector<char> buffer((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            const bool ok = set(buffer.data(), buffer.size(), path);
+#else
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){ return false; }
+            struct stat st;
+            if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(EvalParamsHeader)){
+                ::close(fd); return false;
+            }
+            void *const m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if(m == MAP_FAILED){ return false; }
+            const bool ok = set(static_cast<const char*>(m), st.st_size, path);
+            munmap(m, st.st_size);
+#endif
+            return ok;
+        }
+        
+        template<class value_t>
+        static bool write(const std::string& path, const value_t *const values){
+            // 16ビットに丸めて書き出す
+            std::ofstream ofs(path, std::ios::binary);
+            if(!ofs){ return false; }
+            EvalParamsHeader header;
+            memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.params = kNumEvalParams;
+            header.reserved = 0;
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for(int i = 0; i < kNumEvalParams; ++i){
+                const int16_t v = static_cast<int16_t>(max(-32768.0, min(std::round(double(values[i])), 32767.0)));
+                ofs.write(reinterpret_cast<const char*>(&v), sizeof(v));
+            }
+            return bool(ofs);
+        }
+        
+        EvalParams(){ setDefault(); }
+    
+    private:
+        alignas(64) std::array<int16_t, kNumEvalParams> values_;
+        
+        bool set(const char *const p, size_t size, const std::string& path){
+            const EvalParamsHeader *const header = reinterpret_cast<const EvalParamsHeader*>(p);
+            if(size < sizeof(EvalParamsHeader)
+               || memcmp(header->magic, kMagic, sizeof(kMagic)) || header->version != kVersion
+               || header->params != kNumEvalParams
+               || size != sizeof(EvalParamsHeader) + kNumEvalParams * sizeof(int16_t)){
+                cerr << "EvalParams::load() : broken parameter file " << path << endl;
+                return false;
+            }
+            memcpy(values_.data(), p + sizeof(EvalParamsHeader), kNumEvalParams * sizeof(int16_t));
+            return true;
+        }
+    };
+    
+    constexpr char EvalParams::kMagic[8];
+    
+    EvalParams evalParams; // 評価関数パラメータ
+}
+
+#endif // TRAX_PARAMS_HPP_
@@ -0,0 +1,141 @@
+/*
+ perf_counter.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_PERF_COUNTER_HPP_
+#define TRAX_PERF_COUNTER_HPP_
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************ハードウェアカウンタ**************************/
+    
+    // Linux の perf_event_open で、呼び出したスレッドの CPU サイクル数などを数える
+    // 探索がメモリ律速(置換表や盤面)か分岐予測律速(タイルの表引き)かを対局中に調べるため
+    // 権限やハードウェアの都合で開けないイベントは無効として扱う
+    
+    struct PerfCounts{
+        enum Event{
+            kCycles, kInstructions, kLLCMisses, kBranchMisses, kDTLBMisses,
+            kNumEvents
+        };
+        
+        std::array<uint64_t, kNumEvents> values{};
+        std::array<bool, kNumEvents> valid{};
+        
+        bool any()const noexcept{
+            return std::find(valid.begin(), valid.end(), true) != valid.end();
+        }
+        PerfCounts& operator+=(const PerfCounts& rhs)noexcept{
+            for(int i = 0; i < kNumEvents; ++i){
+                values[i] += rhs.values[i];
+                valid[i] = valid[i] || rhs.valid[i];
+            }
+            return *this;
+        }
+        std::string toString()const{
+            static const char *const names[kNumEvents] = {
+                "cycles", "instructions", "LLC-misses", "branch-misses", "dTLB-misses",
+            };
+            std::ostringstream oss;
+            for(int i = 0; i < kNumEvents; ++i){
+                oss << (i > 0 ? " " : "") << names[i] << " ";
+                if(valid[i]){ oss << values[i]; }else{ oss << "none"; }
+            }
+            if(valid[kCycles] && valid[kInstructions] && values[kCycles] > 0){
+                oss << " IPC " << std::fixed << std::setprecision(2)
+                << double(values[kInstructions]) / values[kCycles];
+            }
+            return oss.str();
+        }
+    };
+    
+    class PerfCounters{
+    public:
+        bool open(){
+            // 呼び出したスレッドについて数える
+            close();
+#if defined(__linux__)
+            auto cache = [](uint64_t cache, uint64_t op, uint64_t result)->uint64_t{
+                return cache | (op << 8) | (result << 16);
+            };
+            const std::array<std::pair<uint32_t, uint64_t>, PerfCounts::kNumEvents> events = {{
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            }};
+            for(int i = 0; i < PerfCounts::kNumEvents; ++i){
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = events[i].first;
+                attr.config = events[i].second;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                // カウンタが足りずに時分割された場合に補正するため、有効時間と計測時間も読む
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds_[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            }
+#endif
+            return isOpen();
+        }
+        bool isOpen()const noexcept{
+            return std::find_if(fds_.begin(), fds_.end(), [](int fd){ return fd >= 0; }) != fds_.end();
+        }
+        
+        void start(){
+#if defined(__linux__)
+            for(int fd : fds_){
+                if(fd >= 0){
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+        PerfCounts stop(){
+            PerfCounts counts;
+#if defined(__linux__)
+            for(int i = 0; i < PerfCounts::kNumEvents; ++i){
+                const int fd = fds_[i];
+                if(fd < 0){ continue; }
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                uint64_t data[3]; // 値, 有効時間, 計測時間
+                if(read(fd, data, sizeof(data)) != sizeof(data)){ continue; }
+                counts.values[i] = (data[2] > 0 && data[2] < data[1])
+                ? uint64_t(double(data[0]) * data[1] / data[2]) : data[0];
+                counts.valid[i] = data[2] > 0;
+            }
+#endif
+            return counts;
+        }
+        
+        void close(){
+#if defined(__linux__)
+            for(int& fd : fds_){
+                if(fd >= 0){ ::close(fd); }
+                fd = -1;
+            }
+#endif
+        }
+        
+        PerfCounters(){ fds_.fill(-1); }
+        ~PerfCounters(){ close(); }
+    
+    private:
+        std::array<int, PerfCounts::kNumEvents> fds_;
+    };
+}
+
+#endif // TRAX_PERF_COUNTER_HPP_
@@ -0,0 +1,183 @@
+/*
+ perft.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_PERFT_HPP_
+#define TRAX_PERFT_HPP_
+
+#include "trax.hpp"
+#include "board.hpp"
+
+namespace Trax{
+    
+    /**************************Perft**************************/
+    
+    // 指定深さまでの合法な着手列を数え上げ、探索と切り離して盤面の着手生成と make/unmake の速度を測る
+    // 着手は線の端点から生成する擬合法手で、連鎖で置かれるタイルで非合法になったものは別に数える
+    // 終局した局面はそれ以上展開しない
+    
+    struct PerftResult{
+        uint64_t leaves = 0; // 最後の深さの合法手の数
+        uint64_t illegal = 0; // 連鎖で非合法になった着手の数
+        uint64_t terminal = 0; // 終局した着手の数
+        uint64_t nodes = 0; // makeMove を呼んだ回数
+        
+        PerftResult& operator+=(const PerftResult& rhs)noexcept{
+            leaves += rhs.leaves;
+            illegal += rhs.illegal;
+            terminal += rhs.terminal;
+            nodes += rhs.nodes;
+            return *this;
+        }
+        bool operator==(const PerftResult& rhs)const noexcept{
+            return leaves == rhs.leaves && illegal == rhs.illegal
+            && terminal == rhs.terminal && nodes == rhs.nodes;
+        }
+    };
+    
+    class PerftTable{
+        // 部分木の数え上げ結果の置換表
+        // 複数スレッドから読み書きするので、キーに内容を XOR して壊れたエントリを弾く
+    public:
+        void SetSize(size_t megabytes){
+            const size_t bytes = megabytes * 1024 * 1024;
+            size_ = static_cast<size_t>(1) << bsr<uint64_t>(max(bytes / sizeof(Entry), size_t(1)));
+            mask_ = size_ - 1;
+            table_.reset(new Entry[size_]);
+            Clear();
+        }
+        void Clear(){
+            for(size_t i = 0; i < size_; ++i){
+                table_[i].check.store(0, std::memory_order_relaxed);
+            }
+        }
+        bool empty()const noexcept{ return size_ == 0; }
+        
+        bool LookUp(uint64_t key, PerftResult *const pr)const{
+            const Entry& e = table_[key & mask_];
+            PerftResult r;
+            r.leaves = e.leaves.load(std::memory_order_relaxed);
+            r.illegal = e.illegal.load(std::memory_order_relaxed);
+            r.terminal = e.terminal.load(std::memory_order_relaxed);
+            r.nodes = e.nodes.load(std::memory_order_relaxed);
+            if(e.check.load(std::memory_order_relaxed) != checksum(key, r)){ return false; }
+            *pr = r;
+            return true;
+        }
+        void Save(uint64_t key, const PerftResult& r){
+            Entry& e = table_[key & mask_];
+            e.leaves.store(r.leaves, std::memory_order_relaxed);
+            e.illegal.store(r.illegal, std::memory_order_relaxed);
+            e.terminal.store(r.terminal, std::memory_order_relaxed);
+            e.nodes.store(r.nodes, std::memory_order_relaxed);
+            e.check.store(checksum(key, r), std::memory_order_relaxed);
+        }
+        
+        static uint64_t key(uint64_t hash, Color turnColor, int depth)noexcept{
+            // 局面のハッシュ値は手番を含まないので手番と深さを混ぜる
+            return mixHash64(((hash & ~1ULL) | turnColor) ^ (uint64_t(depth) * 0x9e3779b97f4a7c15ULL));
+        }
+    
+    private:
+        struct Entry{
+            std::atomic<uint64_t> check, leaves, illegal, terminal, nodes;
+        };
+        
+        static uint64_t checksum(uint64_t key, const PerftResult& r)noexcept{
+            // 空のエントリが一致しないように 0 を避ける
+            return (key ^ r.leaves ^ (r.illegal << 1) ^ (r.terminal << 2) ^ (r.nodes << 3)) | 1ULL;
+        }
+        
+        std::unique_ptr<Entry[]> table_;
+        size_t size_ = 0, mask_ = 0;
+    };
+    
+    template<int kSize>
+    int generatePerftMoves(Move *const pmv0, const BoardT<kSize>& bd){
+        // 2つの端点に接するマスからは同じ着手が2回生成されるので1つにする
+        const int n = generateMoves(pmv0, bd);
+        auto order = [](const Move& mv)->uint32_t{ return (uint32_t(mv.z()) << 8) | uint32_t(mv.tile()); };
+        std::sort(pmv0, pmv0 + n, [&](const Move& a, const Move& b)->bool{ return order(a) < order(b); });
+        return std::unique(pmv0, pmv0 + n) - pmv0;
+    }
+    
+    template<int kSize>
+    PerftResult perft(BoardT<kSize>& bd, int depth, PerftTable *const ptable = nullptr){
+        PerftResult r;
+        if(depth <= 0){ return r; }
+        uint64_t key = 0;
+        if(ptable != nullptr && depth > 1){
+            key = PerftTable::key(bd.hash, bd.turnColor(), depth);
+            if(ptable->LookUp(key, &r)){ return r; }
+        }
+        Move buffer[1024];
+        const int n = generatePerftMoves(buffer, bd);
+        for(int i = 0; i < n; ++i){
+            const int ret = bd.template makeMove<true>(buffer[i]);
+            r.nodes += 1;
+            if(ret < 0){ // 連鎖で非合法(makeMove の中で戻されている)
+                r.illegal += 1;
+                continue;
+            }
+            if(ret > 0){
+                r.terminal += 1;
+            }
+            if(depth == 1){
+                r.leaves += 1;
+            }else if(ret == 0){
+                r += perft(bd, depth - 1, ptable);
+            }
+            bd.template unmakeMove<true>();
+        }
+        if(ptable != nullptr && depth > 1){
+            ptable->Save(key, r);
+        }
+        return r;
+    }
+    
+    template<int kSize>
+    PerftResult parallelPerft(const BoardT<kSize>& root, int depth, int numThreads, PerftTable *const ptable = nullptr){
+        // ルートの着手をスレッドで分けて数える
+        if(depth <= 0){ return PerftResult(); }
+        Move rootMoves[1024];
+        const int n = generatePerftMoves(rootMoves, root);
+        std::atomic<int> next(0);
+        std::vector<PerftResult> results(numThreads);
+        std::vector<std::thread> threads;
+        for(int th = 0; th < numThreads; ++th){
+            threads.emplace_back([&, th]()->void{
+                std::unique_ptr<BoardT<kSize>> pbd(new BoardT<kSize>); // 盤面は大きいのでヒープに置く
+                BoardT<kSize>& bd = *pbd;
+                bd.clear();
+                bd.syncWith(root);
+                PerftResult& r = results[th];
+                for(int i; (i = next.fetch_add(1)) < n;){
+                    const int ret = bd.template makeMove<true>(rootMoves[i]);
+                    r.nodes += 1;
+                    if(ret < 0){
+                        r.illegal += 1;
+                        continue;
+                    }
+                    if(ret > 0){
+                        r.terminal += 1;
+                    }
+                    if(depth == 1){
+                        r.leaves += 1;
+                    }else if(ret == 0){
+                        r += perft(bd, depth - 1, ptable);
+                    }
+                    bd.template unmakeMove<true>();
+                }
+            });
+        }
+        PerftResult total;
+        for(int th = 0; th < numThreads; ++th){
+            threads[th].join();
+            total += results[th];
+        }
+        return total;
+    }
+}
+
+#endif // TRAX_PERFT_HPP_
@@ -18,6 +18,24 @@ namespace Trax{
         
         // -R @0+ B1+ C1+ @1+ D0+ D0/ B2/ C4\ -F
         
+        template<class board_t>
+        Score Search::evaluate(board_t& bd){
+            // 手番側から見た静的評価点
+            // 強制手のために合流が多く、スレッド間でも同じ末端を評価するので評価点キャッシュを引く
+            // 評価関数は盤面の回転や反転で値が変わりうるので対称形はまとめない
+            // 大きさの違う盤面でキャッシュを共有するので、絶対座標ではなく平行移動だけを考慮したキーで引く
+            const Key64 key = static_cast<Key64>(calcRelativeHash(bd));
+            evalHashProbes_ += 1;
+            Score eval = Global::evalHash.LookUp(key);
+            if(eval != kScoreNone){
+                evalHashHits_ += 1;
+                return eval;
+            }
+            eval = bd.evaluate(bd.turnColor());
+            Global::evalHash.Save(key, eval);
+            return eval;
+        }
+        
         void Search::PrepareForNextSearch() {
             // 探索情報をリセットする
             /*num_nodes_searched_ = 0;
@@ -73,6 +91,9 @@ namespace Trax{
                                                       board_t& bd,
                                                       moveIterator_t *const bufferIterator){
             // 高速化を掛けずに詰みを探索
+            if(Global::signals.load(std::memory_order_relaxed) & Global::SIGNAL_STOP){
+                return std::make_tuple(kMoveNone, kScoreZero);
+            }
             const Color myColor = bd.turnColor();
             const Color oppColor = flipColor(myColor);
             const int moves = generateMoves(bufferIterator, bd);
@@ -98,6 +119,9 @@ namespace Trax{
                     }
                 }
                 bd.template unmakeMove<true>();
+                if(Global::signals.load(std::memory_order_relaxed) & Global::SIGNAL_STOP){
+                    return std::make_tuple(kMoveNone, kScoreZero);
+                }
                 if(score >= kScoreKnownWin){
                     return std::make_tuple(bufferIterator[m], score);
                 }
@@ -129,8 +153,15 @@ namespace Trax{
             const Color oppColor = flipColor(myColor);
             int moves;
             
+            // 停止命令はノードに入るごとに確認する
+            // 各ループは子ノードから戻った直後にも確認するので、どのループも1ノード以内で抜ける
+            if(Global::signals.load(std::memory_order_relaxed) & Global::SIGNAL_STOP){
+                return MoveScore(kMoveNone, kScoreZero);
+            }
+            
             // ノードを初期化する
             StackData* const ss = search_stack_at_ply(ply);
+            max_reach_ply_ = max(max_reach_ply_, ply);
             const bool in_check = bd.attacks[oppColor] > 0;
             bool mate3_tried = false;
             
@@ -155,13 +186,26 @@ namespace Trax{
             // 置換表を参照する
             //Move excluded_move = ss->excluded_move;
             //Key64 pos_key = excluded_move != kMoveNone ? node.exclusion_key() : node.key();
+            // 対称ハッシュ値は盤面で差分計算されているので、全局面で対称性を考慮して引く
+            // 置換表の着手は代表の対称型での相対座標で保存されている
+            PROFILE_START;
             int pat;
-            Key64 positionKey = (bd.moves < 8) ? static_cast<Key64>(calcRepRelativeHash(bd, pat)) : bd.key();
+            Key64 positionKey = static_cast<Key64>(calcRepRelativeHash(bd, pat));
             //Key64 positionKey = bd.key();
             const HashEntry* entry = Global::tt.LookUp(positionKey);
+            PROFILE_END(kProfileTTProbe);
+            ttProbes_ += 1;
+            if(entry != nullptr){
+                ttHits_ += 1;
+            }
+            if(Global::visitTable != nullptr){
+                Global::visitTable->Visit(positionKey, threadIndex_);
+            }
             
             Score hashScore = entry ? entry->score() : kScoreNone;
-            Move hashMove = entry ? entry->move() : kMoveNone;
+            Move hashMove = entry ? fromSymmetryMove(entry->move(), bd, pat) : kMoveNone;
+            // 以前に探索されていれば静的評価点も置換表にある
+            ss->staticScore = entry ? entry->eval() : kScoreNone;
             //ss->hash_move = hash_move;
             
             // Hash Cut
@@ -206,6 +250,11 @@ namespace Trax{
                 return MoveScore(hashMove, hashScore);
             }
             
+            // 置換表に静的評価点が無ければここで評価して(評価点キャッシュも引く)、探索後の Save で置換表に残す
+            if(ss->staticScore == kScoreNone){
+                ss->staticScore = evaluate(bd);
+            }
+            
             // 相手の色のスレートがある場合、回避手のみ生成
             
             // 相手のアタックが無く、自分のスレートがある場合勝ち
@@ -216,10 +265,19 @@ namespace Trax{
                     Move move = ss->killers[k];
                     if(move != kMoveNone
                        && bd.isPseudoLegalMove(move)){ // 全くもって非合法な場合もある
+                        // 強制手の処理の間に子局面の置換表と評価点キャッシュのエントリを読み込んでおく
+                        const Key64 childKey = static_cast<Key64>(predictRepRelativeHash(bd, move));
+                        if(depth > kDepthZero){
+                            Global::tt.Prefetch(childKey);
+                        }
+                        Global::evalHash.Prefetch(static_cast<Key64>(predictRelativeHash(bd, move)));
+                        PROFILE_START;
                         int ret = bd.template makeMove<true>(move);
+                        PROFILE_END(kProfileMake);
                         ss->currentMove = move;
                         
                         Global::nodes += 1;
+                        numNodesSearched += 1;
                         
                         if(ret < 0){ // illegal move
                             ASSERT(bd.exam(),);
@@ -234,7 +292,9 @@ namespace Trax{
                             score = -kScoreMate + static_cast<Score>(bd.turn);
                             Global::oppMate += 1;
                         }else{
+                            PROFILE_START;
                             bd.checkSetAttacks(); // アタック情報を更新
+                            PROFILE_END(kProfileAttacks);
                             if(depth < kOnePly * 8
                                && bd.attacks[oppColor]){ // 相手の色のアタックが有ったら負け
                                 score = -kScoreMate + static_cast<Score>(bd.turn + 1);
@@ -249,7 +309,9 @@ namespace Trax{
                             }else{
                                 // 通常の評価に入る
                                 if(depth <= kDepthZero && (!bd.attacks[myColor] || bd.moves > kMaxTiles)){
-                                    score = -bd.evaluate(oppColor);
+                                    PROFILE_START;
+                                    score = -evaluate(bd);
+                                    PROFILE_END(kProfileEvaluate);
                                     score += static_cast<Score>((Global::dice.rand() % 20) - 10); // random score
                                 }else{
                                     MoveScore ms;
@@ -292,7 +354,9 @@ namespace Trax{
             
             // 着手生成
             // ルート以外では初手の可能性はない
+            PROFILE_START;
             moves = kIsRoot ? generateMoves(bufferIterator, bd) : generateNewerLineMoves(bufferIterator, bd);//generateMoves<true>(bufferIterator, bd);
+            PROFILE_END(kProfileGenerate);
             
             if(0 && threadIndex_ == 0 && ply == 0){
                 cerr << bd.toString();
@@ -365,10 +429,19 @@ namespace Trax{
                 //if(Global::historyStats[move.z()][move.tile()] < )
                 
                 //ASSERT(bd.isPseudoLegalMove(move), cerr << move << endl;);
+                // 強制手の処理の間に子局面の置換表と評価点キャッシュのエントリを読み込んでおく
+                const Key64 childKey = static_cast<Key64>(predictRepRelativeHash(bd, move));
+                if(depth > kDepthZero){
+                    Global::tt.Prefetch(childKey);
+                }
+                Global::evalHash.Prefetch(static_cast<Key64>(predictRelativeHash(bd, move)));
+                PROFILE_START;
                 int ret = bd.template makeMove<true>(move);
+                PROFILE_END(kProfileMake);
                 ss->currentMove = move;
                 
                 Global::nodes += 1;
+                numNodesSearched += 1;
                 
                 if(ret < 0){ // illegal move
                     ASSERT(bd.exam(),);
@@ -385,7 +458,9 @@ namespace Trax{
                     score = -kScoreMate + static_cast<Score>(bd.turn);
                     Global::oppMate += 1;
                 }else{
+                    PROFILE_START;
                     bd.checkSetAttacks(); // アタック情報を更新
+                    PROFILE_END(kProfileAttacks);
                     if(depth < kOnePly * 8
                        && bd.attacks[oppColor]){ // 相手の色のアタックが有ったら負け
                         score = -kScoreMate + static_cast<Score>(bd.turn + 1);
@@ -471,7 +546,9 @@ namespace Trax{
                                    score = static_cast<Score>(-ms.score);
                                }
                            }else{
-                               score = -bd.evaluate(oppColor);
+                               PROFILE_START;
+                               score = -evaluate(bd);
+                               PROFILE_END(kProfileEvaluate);
                                //score += static_cast<Score>((Global::dice.rand() % 20) - 10); // random score
                            }
                     }
@@ -483,7 +560,7 @@ namespace Trax{
                 if (Global::signals.load() & Global::SIGNAL_STOP) {
                     return MoveScore(kMoveNone, kScoreZero);
                 }else if(Global::clock.stop() > LIMIT_TIME){ // 時間管理
-                    Global::signals |= Global::SIGNAL_STOP;
+                    Global::requestStop(threadIndex_);
                     return MoveScore(kMoveNone, kScoreZero);
                 }
                 
@@ -549,14 +626,21 @@ namespace Trax{
                 ASSERT(bd.exam(),);
             }
             
+            // 合法手が無ければ引き分け(8x8 Trax で盤面が埋まった場合)
+            // 通常の Trax では起こらないので、他の盤面では全ての手が枝刈りされた場合の値を変えない
+            if(std::is_base_of<Board8x8, board_t>::value && bestScore == -kScoreInfinite){
+                bestScore = kScoreDraw;
+            }
+            
         search_end:
             // 置換表に新しいデータを保存
-            Global::tt.Save(positionKey, bestMove, bestScore, depth,
+            PROFILE_START;
+            Global::tt.Save(positionKey, toSymmetryMove(bestMove, bd, pat), bestScore, depth,
                             bestScore >= beta              ? kBoundLower :
                             kIsPv && bestMove != kMoveNone ? kBoundExact : kBoundUpper,
-                            //ss->static_score,
-                            bestScore,
+                            ss->staticScore,
                             false);
+            PROFILE_END(kProfileTTStore);
             // ヒストリーの更新
             //Score bonus = Score((depth / kOnePly) * int(depth / kOnePly) + 2 * depth / kOnePly - 2);
             //Global::historyStats.update(bestMove, (myColor == WHITE) ? bestScore : -bestScore);
@@ -589,6 +673,7 @@ namespace Trax{
                 Move move = Move(moves[m]);
                 int ret = bd.template makeMove<true>(move);
                 Global::nodes += 1;
+                numNodesSearched += 1;
                 
                 //ms = MoveScore(kMoveNull);
                 
@@ -615,7 +700,7 @@ namespace Trax{
                         Global::myDoubleAttacks += 1;
                     }else{
                         if(depth <= kDepthZero && !bd.attacks[myColor]){
-                            score = -bd.evaluate(oppColor);
+                            score = -evaluate(bd);
                         }else{
                             
                             Depth nextDepth = depth - kOnePly;
@@ -649,6 +734,11 @@ namespace Trax{
                 
                 bd.template unmakeMove<true>();
                 
+                // 止められた探索の評価点でルートの着手の評価点を上書きしない
+                if(Global::signals.load(std::memory_order_relaxed) & Global::SIGNAL_STOP){
+                    return MoveScore(kMoveNone, kScoreZero);
+                }
+                
                 //if(Move(ms) != kMoveNone){
                     moves[m].score = score;
                     
@@ -664,22 +754,87 @@ namespace Trax{
                         }
                     }
                // }
-                
-                if(Global::signals.load() & Global::SIGNAL_STOP){
-                    return MoveScore(kMoveNone, kScoreZero);
-                }
             }
             return MoveScore(bestMove, bestScore);
         }
         
+        template<class board_t>
+        std::vector<std::string> probePV(board_t& bd, Move bestMove, int maxLength){
+            // ルートの最善手から置換表の最善手をたどって読み筋の棋譜表記を得る(盤面は元に戻す)
+            // ルート局面は置換表に保存されないので最善手は引数で渡す
+            // 他のスレッドが書き換えている途中のエントリもあるので擬合法性を確かめて進める
+            std::vector<std::string> pv;
+            while(int(pv.size()) < maxLength){
+                Move move = bestMove;
+                if(!pv.empty()){
+                    int pat;
+                    const Key64 key = static_cast<Key64>(calcRepRelativeHash(bd, pat));
+                    const HashEntry *const entry = Global::tt.LookUp(key);
+                    if(entry == nullptr || entry->move() == kMoveNone){ break; }
+                    move = fromSymmetryMove(entry->move(), bd, pat);
+                }
+                if(move == kMoveNone || !bd.isPseudoLegalMove(move)){ break; }
+                const std::string notation = toNotationString(move, bd);
+                const int ret = bd.template makeMove<true>(move);
+                if(ret < 0){ break; }
+                pv.push_back(notation);
+                if(ret > 0){ break; }
+            }
+            for(size_t i = 0; i < pv.size(); ++i){
+                bd.template unmakeMove<true>();
+            }
+            return pv;
+        }
+        
+        template<class board_t>
+        std::string Search::toTelemetryString(board_t& bd, const MoveScoreDepth& best, int iteration, uint64_t iterationTime){
+            // 1イテレーション分の記録(JSON)
+            const uint64_t time = Global::clock.stop();
+            std::vector<uint64_t> threadNodes = {nodesSearched()};
+            Global::manager.ForEachActiveWorker([&threadNodes](const SearchThread& worker)->void{
+                threadNodes.push_back(worker.search_.nodesSearched());
+            });
+            const uint64_t nodes = std::accumulate(threadNodes.begin(), threadNodes.end(), uint64_t(0));
+            std::ostringstream oss;
+            oss << "{\"type\":\"iteration\",\"turn\":" << bd.turn
+            << ",\"ponder\":" << (this == Global::manager.ponder_search_.get() ? "true" : "false")
+            << ",\"iteration\":" << (iteration + 1) << ",\"depth\":" << best.depth
+            << ",\"seldepth\":" << max_reach_ply_
+            << ",\"time_ms\":" << time << ",\"iteration_ms\":" << iterationTime
+            << ",\"nodes\":" << nodes << ",\"thread_nodes\":[";
+            for(size_t th = 0; th < threadNodes.size(); ++th){
+                oss << (th > 0 ? "," : "") << threadNodes[th];
+            }
+            oss << "],\"nps\":" << (nodes * 1000 / max(time, uint64_t(1)))
+            << ",\"hashfull\":" << Global::tt.hashfull()
+            << ",\"move\":" << toJsonString(toNotationString(Move(best), bd))
+            << ",\"score\":" << best.score << ",\"pv\":[";
+            const std::vector<std::string> pv = probePV(bd, Move(best), iteration + 1);
+            for(size_t i = 0; i < pv.size(); ++i){
+                oss << (i > 0 ? "," : "") << toJsonString(pv[i]);
+            }
+            oss << "]}";
+            return oss.str();
+        }
+        
         template<class board_t>
         //SearchResult
         
         MoveScoreDepth Search::iterativeDeepening(board_t& bd){
             
-            Global::signals |= 1ULL << threadIndex_; // 探索中のスレッドフラグをつける
+            // 学習モードでは各スレッドが別々の局面を探索するので、全体への停止命令や表示は行わない
+            if(!learning_mode_){
+                Global::signals |= 1ULL << threadIndex_; // 探索中のスレッドフラグをつける
+            }
             
             prepareSearch(); // 探索スタック等初期化
+            TimelineRecorder& timeline = Global::timeline;
+            const bool recordTimeline = timeline.enabled() && !learning_mode_;
+            const uint64_t searchBegin = learning_mode_ ? 0 : timeline.now();
+            PerfCounters perf; // カウンタはこのスレッドについて数えるので探索ごとに開く
+            if(Global::perfCounting && !learning_mode_ && perf.open()){
+                perf.start();
+            }
             ClockMS localClock; // ponderスレッドがいつまでも生き残らないようにローカルの時計でも終了判定する
             localClock.start();
             
@@ -693,18 +848,23 @@ namespace Trax{
             
             MoveScore ms;
             
+            uint64_t iterationStartTime = Global::clock.stop();
+            
             // 反復深化
-            for(int iteration = 0; iteration < kMaxPly; ++iteration){
+            for(int iteration = 0; iteration < min(kMaxPly, Global::searchDepthLimit); ++iteration){
                 
                 // Lazy SMP
                 // ワーカースレッドは、平均して２回に１回、スキップする
-                if (!(isMasterThread() || ((threadIndex_ == 1)  && bd.turnColor() != Global::rootColor))){
+                // 学習モードの探索はスレッドごとに独立なので飛ばさない
+                if (!learning_mode_ && !isMasterThread()){
                     const auto& halfDensity = halfDensityTable[(threadIndex_ - 1) % halfDensityTableSize];
                     if (halfDensity[(iteration + bd.turn) % halfDensity.size()]) {
                         continue;
                     }
                 }
                 
+                const uint64_t iterationBegin = recordTimeline ? timeline.now() : 0;
+                
                 // αβウィンドウをセットする
                 Score alpha = -kScoreInfinite, beta = kScoreInfinite;
                 
@@ -741,7 +901,7 @@ namespace Trax{
                     if(Global::signals.load() & Global::SIGNAL_STOP){
                         break;
                     }else if(localClock.stop() > LIMIT_TIME){ // 時間管理
-                        Global::signals |= Global::SIGNAL_STOP;
+                        Global::requestStop(threadIndex_);
                         break;
                     }
                     
@@ -787,11 +947,15 @@ namespace Trax{
                 assert(score != kScoreNone);
                 
                 // スタッツ表示
-                if(isMasterThread()
-                   || (Global::rootColor != bd.turnColor() && threadIndex_ == 1)){ // ponder時は1番スレッド
+                if(isMasterThread() && !learning_mode_){ // ponder時もマスタースレッドが表示
                     CERR << "iteration = " << (iteration + 1) << " time = " << Global::clock.stop();
                     CERR << " move = " << toNotationString(Move(best), bd) << " score = " << best.score;
                     CERR << " " << Global::toLineStatsString();
+                    if(Global::telemetry.isOpen()){
+                        const uint64_t time = Global::clock.stop();
+                        Global::telemetry.push(toTelemetryString(bd, best, iteration, time - iterationStartTime));
+                        iterationStartTime = time;
+                    }
                     
                     /*if(abs(best.score) >= kScoreMate - (iteration + 1 + bd.turn)){
                      // 勝ち or 負け
@@ -800,19 +964,42 @@ namespace Trax{
                      }*/
                 }
                 
+                if(recordTimeline){
+                    timeline.span("iteration", threadIndex_, iterationBegin, timeline.now(), iteration + 1);
+                }
+                
                 if(Global::signals.load() & Global::SIGNAL_STOP){
                     break;
                 }else if(localClock.stop() > LIMIT_TIME){ // 時間管理
-                    Global::signals |= Global::SIGNAL_STOP;
+                    Global::requestStop(threadIndex_);
+                    break;
+                }else if(learning_mode_ && iteration + 1 >= learningDepth_){
+                    break;
+                }else if(isMasterThread() && iteration + 1 >= Global::searchDepthLimit){
+                    // 深さ制限に達したらワーカースレッドも止める
+                    Global::requestStop(threadIndex_);
                     break;
                 }
             } // イテレーションのループ
-            if(isMasterThread()){
-                CERR << Global::toFullStatsString();
+            if(learning_mode_){
+                return best;
             }
             
             //return std::move(result);
             
+            if(perf.isOpen()){
+                Global::perfCounts[threadIndex_] = perf.stop();
+            }
+            // 停止命令からこのスレッドが探索を抜けるまで
+            Global::stopLatency[threadIndex_] = -1;
+            const uint64_t stopRequestTime = Global::stopRequestTime;
+            if(stopRequestTime >= searchBegin){
+                const uint64_t searchEnd = timeline.now();
+                Global::stopLatency[threadIndex_] = searchEnd - stopRequestTime;
+                if(recordTimeline){
+                    timeline.span("stop latency", threadIndex_, stopRequestTime, searchEnd);
+                }
+            }
             Global::signals &= ~(1ULL << threadIndex_); // 探索中のスレッドフラグを消す
             
             return best;
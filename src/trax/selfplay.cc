@@ -0,0 +1,262 @@
+/*
+ selfplay.cc
+ Katsuki Ohto
+ */
+
+// 評価関数学習用の自己対戦
+// スレッドごとに盤面と探索を持って浅い探索で独立に対局し(深さ 0 では探索せず 1 手先の静的評価で指す)、
+// 各局面の特徴量と探索の点(深さ 0 なら静的評価点)、対局結果を学習用局面ファイル(learn.hpp)に書き出す
+// 置換表と評価点キャッシュは全スレッドで共有する
+
+#include "trax.hpp"
+#include "board.hpp"
+#include "kizuna.h"
+
+uint64_t LIMIT_TIME = -1; // 時間では止めず、深さで止める
+
+#include "search.hpp"
+#include "learn.hpp"
+
+using namespace Trax;
+
+std::atomic<int64_t> gamesStarted, gamesFinished, positionsWritten;
+
+template<class node_t>
+Score evaluateWithCache(node_t& nd){
+    // 手番側から見た静的評価点(探索と同じ評価点キャッシュを引く)
+    const Key64 key = static_cast<Key64>(calcRelativeHash(nd));
+    Score eval = Global::evalHash.LookUp(key);
+    if(eval == kScoreNone){
+        eval = nd.evaluate(nd.turnColor());
+        Global::evalHash.Save(key, eval);
+    }
+    return eval;
+}
+
+template<class node_t>
+Move selectStaticMove(node_t& nd, int width, XorShift64 *const pdice){
+    // 深さ 0 用に、探索せず 1 手先だけを見て指し手を選ぶ
+    // 全ての手について、勝ちの手と回避不能なアタックを作る手を探し、相手のアタックが残る手は負けとして除く
+    // 残りの手から無作為に width 手(0 なら全て)を選んで静的評価し、最も良い手を指す
+    // 評価が一番重いので選ぶ手数で速さを決め、探索の末端と同じく小さな乱数を足して対局がばらけるようにする
+    const Color myColor = nd.turnColor();
+    const Color oppColor = flipColor(myColor);
+    std::vector<Move> safeMoves, losingMoves;
+    for(Move mv : generateMoveVector<Move, true>(nd)){
+        const int ret = nd.makeMove(mv);
+        if(ret < 0){ continue; } // 失敗した着手は makeMove の中で戻されている
+        bool win = false, lose = false;
+        if(ret > 0){
+            win = (whichWon(ret, myColor) == myColor);
+            lose = !win;
+        }else{
+            nd.checkSetAttacks();
+            if(nd.attacks[oppColor]){
+                lose = true;
+            }else{
+                win = nd.hasInevasibleAttacks(myColor);
+            }
+        }
+        nd.unmakeMove();
+        if(win){ return mv; }
+        (lose ? losingMoves : safeMoves).push_back(mv);
+    }
+    if(safeMoves.empty()){
+        return losingMoves.empty() ? kMoveNone : losingMoves[pdice->rand() % losingMoves.size()];
+    }
+    if(width > 0 && safeMoves.size() > size_t(width)){
+        for(int i = 0; i < width; ++i){
+            std::swap(safeMoves[i], safeMoves[i + pdice->rand() % (safeMoves.size() - i)]);
+        }
+        safeMoves.resize(width);
+    }
+    Move bestMove = kMoveNone;
+    int bestScore = -kScoreInfinite;
+    for(Move mv : safeMoves){
+        nd.makeMove(mv);
+        const int score = -evaluateWithCache(nd) + static_cast<int>(pdice->rand() % 20) - 10;
+        nd.unmakeMove();
+        if(score > bestScore){
+            bestScore = score;
+            bestMove = mv;
+        }
+    }
+    return bestMove;
+}
+
+void playGames(int th, int64_t numGames, int depth, int width, int randomMoves, int maxMoves,
+               uint64_t seed, TeacherWriter *const pwriter){
+    // 盤面と探索は大きいのでヒープに置く
+    // 対局と同じく小さい盤面で指し、盤端に近づいたら大きい盤面に移る
+    // 探索は学習モードで他のスレッドと独立に止まる
+    // 深さ 0 では探索を使わず、静的評価点を教師にして指し手は 1 手先の静的評価で選ぶ
+    std::unique_ptr<NarrowNode> pnarrow(new NarrowNode);
+    std::unique_ptr<Node> pwide(new Node);
+    std::unique_ptr<KizuNa::Search> psearch;
+    if(depth > 0){
+        psearch.reset(new KizuNa::Search(th));
+        psearch->setLearningMode(depth);
+    }
+    XorShift64 dice;
+    dice.srand(seed + th * 0x9e3779b97f4a7c15ULL);
+    
+    std::vector<TeacherPosition> positions;
+    std::vector<TeacherFeature> features;
+    std::vector<char> buffer;
+    
+    while(gamesStarted.fetch_add(1) < numGames){
+        pnarrow->clear();
+        positions.clear();
+        features.clear();
+        bool wide = false;
+        Color winner = COLOR_NONE;
+        for(int t = 0; t < maxMoves; ++t){
+            if(!wide && !Global::fitsNarrowNode(*pnarrow)){
+                pwide->syncWith(*pnarrow);
+                wide = true;
+            }
+            // 1手指す(終局したら false)
+            auto step = [&](auto& nd)->bool{
+                Move mv;
+                if(t < randomMoves){
+                    // 序盤は局面が偏らないようにランダムに指す
+                    const std::vector<Move> moves = generateMoveVector<Move, true>(nd);
+                    if(moves.empty()){ return false; }
+                    mv = moves[dice.rand() % moves.size()];
+                }else{
+                    TeacherPosition pos;
+                    const size_t first = features.size();
+                    extractFeatures(nd, &features);
+                    int score;
+                    if(depth == 0){
+                        score = evaluateWithCache(nd);
+                        mv = selectStaticMove(nd, width, &dice);
+                    }else{
+                        const MoveScoreDepth best = psearch->iterativeDeepening(nd);
+                        score = best.score;
+                        mv = Move(best);
+                    }
+                    if(mv == kMoveNone){
+                        features.resize(first);
+                        return false;
+                    }
+                    pos.score = static_cast<int16_t>(max(-32767, min(score, 32767)));
+                    pos.result = nd.turnColor(); // 対局後に結果に置き換える
+                    pos.turn = static_cast<uint8_t>(min(int(nd.turn), 255));
+                    pos.features = static_cast<uint16_t>(features.size() - first);
+                    pos.reserved = 0;
+                    positions.push_back(pos);
+                }
+                const Color turnColor = nd.turnColor();
+                const int ret = nd.makeMove(mv);
+                if(ret < 0){ return false; }
+                if(ret > 0){
+                    winner = whichWon(ret, turnColor);
+                    return false;
+                }
+                return true;
+            };
+            if(!(wide ? step(*pwide) : step(*pnarrow))){ break; }
+        }
+        
+        // 対局結果を手番側から見た値にして書き出す
+        buffer.clear();
+        const TeacherFeature *f = features.data();
+        for(TeacherPosition& pos : positions){
+            const Color c = static_cast<Color>(pos.result);
+            pos.result = (winner == COLOR_NONE) ? 0 : (winner == c ? +1 : -1);
+            TeacherWriter::append(&buffer, pos, f);
+            f += pos.features;
+        }
+        pwriter->write(buffer);
+        positionsWritten += positions.size();
+        gamesFinished += 1;
+    }
+}
+
+int main(int argc, char* argv[]){
+    
+    setvbuf(stdout, NULL, _IONBF, 0);
+    
+    std::string outputFilePath = "./data/teacher.bin";
+    int64_t numGames = 1000;
+    int numThreads = std::thread::hardware_concurrency();
+    int depth = 2; // 各局面の探索深さ(0 なら静的評価点で教師を付ける)
+    int width = 8; // 深さ 0 で静的評価して比べる手の数(0 なら全ての手)
+    int randomMoves = 4; // 序盤にランダムに指す手数
+    int maxMoves = 120; // これを超えたら引き分け
+    int hashMegaBytes = 256;
+    uint64_t seed = time(NULL);
+    
+    for(int c = 1; c < argc; ++c){
+        if(!strcmp(argv[c], "-o")){
+            outputFilePath = std::string(argv[c + 1]);
+        }else if(!strcmp(argv[c], "-g")){
+            numGames = max(1LL, atoll(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-th")){
+            numThreads = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-d")){
+            depth = max(0, min(atoi(argv[c + 1]), int(kMaxPly)));
+        }else if(!strcmp(argv[c], "-w")){
+            width = max(0, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-r")){
+            randomMoves = max(0, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-m")){
+            maxMoves = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-hash")){
+            hashMegaBytes = max(1, atoi(argv[c + 1]));
+        }else if(!strcmp(argv[c], "-s")){
+            seed = strtoull(argv[c + 1], nullptr, 10);
+        }else if(!strcmp(argv[c], "-pi")){
+            if(!evalParams.load(argv[c + 1])){
+                cerr << "failed to load evaluation parameters " << argv[c + 1] << endl;
+                return 1;
+            }
+        }
+    }
+    numThreads = max(1, numThreads);
+    
+    Trax::initTrax();
+    Global::dice.srand(seed);
+    Global::tt.Clear();
+    Global::tt.SetSize(hashMegaBytes);
+    Global::evalHash.SetSize(Global::evalHashMegaBytes);
+    Global::signals = 0;
+    
+    TeacherWriter writer;
+    if(!writer.open(outputFilePath)){
+        cerr << "failed to open " << outputFilePath << endl;
+        return 1;
+    }
+    
+    ClockMS clock;
+    clock.start();
+    std::vector<std::thread> threads;
+    for(int th = 0; th < numThreads; ++th){
+        threads.emplace_back(playGames, th, numGames, depth, width, randomMoves, maxMoves, seed, &writer);
+    }
+    // 進み具合を表示する
+    auto rateString = [&]()->std::string{
+        const double sec = max(double(clock.stop()), 1.0) / 1000.0;
+        std::ostringstream oss;
+        oss << gamesFinished << " games " << positionsWritten << " positions "
+        << int64_t(positionsWritten / sec) << " pos/s (" << int64_t(positionsWritten / sec / numThreads) << " pos/s/thread)";
+        return oss.str();
+    };
+    uint64_t nextReport = 1000;
+    while(gamesFinished < numGames){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if(clock.stop() >= nextReport){
+            cerr << rateString() << endl;
+            nextReport += 1000;
+        }
+    }
+    for(std::thread& t : threads){
+        t.join();
+    }
+    writer.close();
+    cerr << rateString() << endl;
+    cerr << "wrote to " << outputFilePath << endl;
+    
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ telemetry.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_TELEMETRY_HPP_
+#define TRAX_TELEMETRY_HPP_
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************探索の記録の書き出し**************************/
+    
+    // 探索の経過を1行1レコードの JSON (JSON Lines) でファイルに書き出す
+    // 探索スレッドはリングバッファに積むだけで、ファイルへの書き込みは専用のスレッドが行う
+    // バッファが満杯の時は待たずにレコードを捨てて数える
+    
+    class TelemetryWriter{
+    public:
+        static constexpr size_t kCapacity = 1024;
+        
+        bool open(const std::string& path){
+            close();
+            ofs_.open(path, std::ios::app);
+            if(!ofs_){ return false; }
+            exit_ = false;
+            open_ = true;
+            thread_ = std::thread([this]()->void{ writeLoop(); });
+            return true;
+        }
+        bool isOpen()const noexcept{ return open_; }
+        uint64_t dropped()const noexcept{ return dropped_; }
+        
+        bool push(std::string&& record){
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(tail_ - head_ >= kCapacity){
+                dropped_ += 1;
+                return false;
+            }
+            ring_[tail_++ % kCapacity] = std::move(record);
+            condition_.notify_one();
+            return true;
+        }
+        
+        void close(){
+            // 積まれているレコードを書き終えてから閉じる
+            if(!open_){ return; }
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                exit_ = true;
+                condition_.notify_one();
+            }
+            thread_.join();
+            ofs_.close();
+            open_ = false;
+        }
+        
+        ~TelemetryWriter(){ close(); }
+    
+    private:
+        void writeLoop(){
+            std::vector<std::string> batch;
+            while(true){
+                {
+                    // ロックはレコードを取り出す間だけ持つ
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    condition_.wait(lock, [this](){ return exit_ || head_ != tail_; });
+                    while(head_ != tail_){
+                        batch.push_back(std::move(ring_[head_++ % kCapacity]));
+                    }
+                    if(exit_ && batch.empty()){ break; }
+                }
+                for(const std::string& record : batch){
+                    ofs_ << record << '\n';
+                }
+                ofs_.flush();
+                batch.clear();
+            }
+        }
+        
+        std::array<std::string, kCapacity> ring_;
+        uint64_t head_ = 0, tail_ = 0;
+        std::atomic<uint64_t> dropped_{0};
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::thread thread_;
+        std::ofstream ofs_;
+        bool exit_ = false;
+        bool open_ = false;
+    };
+    
+    std::string toJsonString(const std::string& str){
+        // 棋譜表記の '\' などをエスケープした JSON の文字列
+        std::string json = "\"";
+        for(char c : str){
+            if(c == '"' || c == '\\'){ json += '\\'; }
+            json += c;
+        }
+        return json + "\"";
+    }
+}
+
+#endif // TRAX_TELEMETRY_HPP_
@@ -11,6 +11,11 @@
 #include <mutex>
 #include <thread>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "trax.hpp"
 
 using namespace Trax;
@@ -18,11 +23,28 @@ using namespace Trax;
 namespace Trax{
     namespace KizuNa{
         
-        SearchThread::SearchThread(size_t thread_id, Node& node/*, SharedData& shared_data,
-                                                                ThreadManager& thread_manager*/)
+        // スレッドの優先度設定
+        // low = true で SCHED_BATCH にして、先読みが他プロセスの邪魔をしにくくする
+        // SCHED_BATCH と SCHED_OTHER の間の切り替えは特権無しで出来る
+        template<class handle_t>
+        void setThreadPriority(handle_t handle, bool low){
+#if defined(__linux__)
+            sched_param param;
+            param.sched_priority = 0;
+            pthread_setschedparam(handle, low ? SCHED_BATCH : SCHED_OTHER, &param);
+#endif
+        }
+        
+        void setCurrentThreadPriority(bool low){
+#if defined(__linux__)
+            setThreadPriority(pthread_self(), low);
+#endif
+        }
+        
+        SearchThread::SearchThread(size_t thread_id/*, SharedData& shared_data,
+                                                     ThreadManager& thread_manager*/)
         : //thread_manager_(thread_manager),
         search_(/*shared_data, */thread_id),
-        root_node_(node/*Position::CreateStartPosition()*/),
         searching_{false},
         exit_{false},
         native_thread_([&](){ IdleLoop(); }) {
@@ -51,7 +73,14 @@ namespace Trax{
                     break;
                 }
                 
-                search_.iterativeDeepening(root_node_/*, thread_manager_*/);
+                // 各スレッドの盤面はあらかじめルート局面に同期されている
+                const uint64_t begin = Global::timeline.enabled() ? Global::timeline.now() : 0;
+                Global::visitNode(search_.threadIndex(), [this](auto& nd)->void{
+                    search_.iterativeDeepening(nd/*, thread_manager_*/);
+                });
+                if (Global::timeline.enabled()) {
+                    Global::timeline.span("search", search_.threadIndex(), begin, Global::timeline.now());
+                }
                 
                 // 探索終了後の処理
                 {
@@ -64,10 +93,6 @@ namespace Trax{
             }
         }
         
-        void SearchThread::SetRootNode(const Node& root_node) {
-            root_node_ = root_node;
-        }
-        
         void SearchThread::StartSearching() {
             std::unique_lock<std::mutex> lock(mutex_);
             searching_ = true;
@@ -79,6 +104,10 @@ namespace Trax{
             sleep_condition_.wait(lock, [this](){ return !searching_; });
         }
         
+        void SearchThread::SetPriority(bool low) {
+            setThreadPriority(native_thread_.native_handle(), low);
+        }
+        
         ThreadManager::ThreadManager(/*SharedData& shared_data, TimeManager& time_manager*/)
         /*:shared_data_(shared_data),
          time_manager_(time_manager)*/ {
@@ -86,15 +115,35 @@ namespace Trax{
         
         
         
-        /*uint64_t ThreadManager::CountNodesSearchedByWorkerThreads() const {
-         uint64_t total = 0;
-         for (const std::unique_ptr<SearchThread>& worker : worker_threads_) {
-         total += worker->search_.num_nodes_searched();
-         }
-         return total;
-         }
-         
-         uint64_t ThreadManager::CountNodesUnder(Move move) const {
+        uint64_t ThreadManager::CountNodesSearchedByWorkerThreads() const {
+            uint64_t total = 0;
+            ForEachActiveWorker([&total](const SearchThread& worker)->void{
+                total += worker.search_.nodesSearched();
+            });
+            return total;
+        }
+        
+        void ThreadManager::SumSearchStats(const Search& master_search) {
+            // スレッドごとに数えた統計を、全スレッドの終了を待った後で合計する
+            Global::evalHashProbes = master_search.evalHashProbes();
+            Global::evalHashHits = master_search.evalHashHits();
+            Global::ttProbes = master_search.ttProbes();
+            Global::ttHits = master_search.ttHits();
+            ForEachActiveWorker([](const SearchThread& worker)->void{
+                Global::evalHashProbes += worker.search_.evalHashProbes();
+                Global::evalHashHits += worker.search_.evalHashHits();
+                Global::ttProbes += worker.search_.ttProbes();
+                Global::ttHits += worker.search_.ttHits();
+            });
+        }
+        
+        uint64_t ThreadManager::CountNodesSearched() const {
+            // 直前の ParallelSearch で全スレッドが探索したノード数
+            // Global::nodes はスレッド間で競合して数え落とすので、速度の計測にはこちらを使う
+            return master_nodes_ + CountNodesSearchedByWorkerThreads();
+        }
+        
+        /*uint64_t ThreadManager::CountNodesUnder(Move move) const {
          uint64_t total = 0;
          for (const std::unique_ptr<SearchThread>& worker : worker_threads_) {
          total += worker->search_.GetNodesUnder(move);
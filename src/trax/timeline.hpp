@@ -0,0 +1,101 @@
+/*
+ timeline.hpp
+ Katsuki Ohto
+ */
+
+#ifndef TRAX_TIMELINE_HPP_
+#define TRAX_TIMELINE_HPP_
+
+#include <chrono>
+
+#include "trax.hpp"
+
+namespace Trax{
+    
+    /**************************スレッドの動作の記録**************************/
+    
+    // スレッドごとの区間(イテレーション、先読み、停止待ち、通信など)をリングバッファに記録し、
+    // 終了時に Chrome のトレース形式(JSON)で書き出す(chrome://tracing や Perfetto で開ける)
+    // 名前は文字列リテラルのみで、記録時に確保や書き込みは行わない
+    // バッファが一周したら古い記録から上書きする
+    
+    class TimelineRecorder{
+    public:
+        static constexpr size_t kCapacity = 1 << 16;
+        static constexpr int kMainThread = N_THREADS; // 通信と思考の管理を行うスレッドの番号
+        
+        void open(const std::string& path){
+            path_ = path;
+            events_.reset(new Event[kCapacity]);
+            enabled_ = true;
+        }
+        bool enabled()const noexcept{ return enabled_; }
+        
+        uint64_t now()const{
+            // プログラム開始からの時間(マイクロ秒) 記録していない時も使える
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin_).count();
+        }
+        
+        void span(const char *name, int tid, uint64_t begin, uint64_t end, int64_t arg = -1){
+            // 開始時刻と終了時刻のある区間
+            push(Event{name, tid, 'X', begin, end > begin ? end - begin : 0, arg});
+        }
+        void instant(const char *name, int tid, int64_t arg = -1){
+            push(Event{name, tid, 'i', now(), 0, arg});
+        }
+        
+        bool write()const{
+            std::ofstream ofs(path_);
+            if(!ofs){ return false; }
+            ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+            // レコードの間にだけ区切りを入れる(イベントが無くても正しい JSON になる)
+            const char *separator = "";
+            // スレッド名
+            for(int tid = 0; tid <= kMainThread; ++tid){
+                ofs << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                << ",\"args\":{\"name\":\"" << (tid == kMainThread ? std::string("main") : "search thread " + std::to_string(tid))
+                << "\"}}";
+                separator = ",\n";
+            }
+            const uint64_t next = next_.load();
+            const uint64_t n = min(next, uint64_t(kCapacity));
+            for(uint64_t i = next - n; i < next; ++i){
+                const Event& e = events_[i % kCapacity];
+                ofs << separator << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << e.tid
+                << ",\"ts\":" << e.begin;
+                if(e.phase == 'X'){ ofs << ",\"dur\":" << e.duration; }
+                if(e.phase == 'i'){ ofs << ",\"s\":\"t\""; }
+                if(e.arg >= 0){ ofs << ",\"args\":{\"value\":" << e.arg << "}"; }
+                ofs << "}";
+            }
+            ofs << endl;
+            ofs << "]}" << endl;
+            return bool(ofs);
+        }
+        
+        ~TimelineRecorder(){
+            if(enabled_){ write(); }
+        }
+    
+    private:
+        struct Event{
+            const char *name;
+            int tid;
+            char phase; // 'X' 区間, 'i' 瞬間
+            uint64_t begin, duration;
+            int64_t arg;
+        };
+        
+        void push(const Event& e){
+            events_[next_.fetch_add(1) % kCapacity] = e;
+        }
+        
+        std::string path_;
+        std::unique_ptr<Event[]> events_;
+        std::atomic<uint64_t> next_{0};
+        std::chrono::steady_clock::time_point origin_ = std::chrono::steady_clock::now();
+        bool enabled_ = false;
+    };
+}
+
+#endif // TRAX_TIMELINE_HPP_
@@ -981,6 +981,8 @@ namespace Trax{
     
     /**************************盤面表現定数**************************/
     
+    // 盤面の一辺のマス数の最大値
+    // 盤面クラスはサイズをテンプレート引数に取るので、以下の大域の座標系は最大サイズのもの
     constexpr int SIZE = 128;
     constexpr int MARGIN = 2;
     
@@ -993,34 +995,102 @@ namespace Trax{
     
     constexpr int Z_FIRST = XYtoZ(SIZE / 2 - 1, SIZE / 2 - 1);
     
-    struct XY{
+    template<int kSize>
+    struct XYT{
+        // 座標表示用
         int z;
-        XY(int az):
+        XYT(int az):
         z(az){}
-        XY(int ax, int ay):
-        z(XYtoZ(ax, ay)){}
-        XY(const std::array<int, 2>& a):
-        z(XYtoZ(a[0], a[1])){}
+        XYT(int ax, int ay):
+        z(ax * kSize + ay){}
+        XYT(const std::array<int, 2>& a):
+        z(a[0] * kSize + a[1]){}
     };
     
-    std::ostream& operator<<(std::ostream& ost, const XY& xy){
-        ost << "(" << ZtoX(xy.z) << ", " << ZtoY(xy.z) << ")";
+    template<int kSize>
+    std::ostream& operator<<(std::ostream& ost, const XYT<kSize>& xy){
+        ost << "(" << (xy.z / kSize) << ", " << (xy.z % kSize) << ")";
         return ost;
     }
     
-    uint64_t tileHashTable[SIZE * SIZE][TILE_MAX + 1];
+    using XY = XYT<SIZE>;
     
-    void initHashTable(){
-        //XorShift64 dice(71);
-        std::mt19937 dice(71);
-        for(int i = 0; i < SIZE * SIZE; ++i){
-            for(int j = 0; j <= TILE_MAX; ++j){
-                //tileHashTable[i][j] = dice.rand();
-                tileHashTable[i][j] = (uint64_t(dice()) << 32) | dice(); // mt19937が32ビット...
+    template<int kFrom, int kTo>
+    Move convertMove(const Move& mv){
+        // 盤面サイズの異なる盤面間での着手の変換
+        // どのサイズでも初手は中央に置くので、中央を揃えて平行移動する
+        if(kFrom == kTo || mv == kMoveNone){ return mv; }
+        int x = mv.z() / kFrom - kFrom / 2 + kTo / 2;
+        int y = mv.z() % kFrom - kFrom / 2 + kTo / 2;
+        return Move(x * kTo + y, mv.tile());
+    }
+    
+    constexpr uint64_t mixHash64(uint64_t h)noexcept{
+        // 64ビットの攪拌(splitmix64 の最終段, 全単射)
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+    
+    constexpr uint64_t tileHashKey(int z, int tl)noexcept{
+        // 位置とタイルに対する Zobrist キー
+        // 乱数表(SIZE * SIZE * 6 要素)を引くと盤面のデータがキャッシュから追い出されるので、
+        // (z, tl) を攪拌してその場で作る
+        return mixHash64((uint64_t(z) * (TILE_MAX + 1) + tl + 1) * 0x9e3779b97f4a7c15ULL);
+    }
+    
+    // 平行移動と対称変換を考慮したハッシュ値(差分計算用)
+    // 相対座標 (u, v) のタイル t の値を symmetryTileKey[t] * A^u * B^v (mod 2^64) とし、その和をとる
+    // 盤面は絶対座標で和をとっておき、境界が動いても基準点の分の冪を掛けるだけで相対化できる
+    // 負の冪も使うので A, B は奇数にする
+    constexpr int SYMMETRY_POW_OFFSET = SIZE;
+    uint64_t symmetryTileKey[TILE_MAX + 1];
+    uint64_t symmetryPowTable[2][SYMMETRY_POW_OFFSET * 2 + 1];
+    
+    uint64_t symmetryPow(int axis, int e)noexcept{
+        ASSERT(-SYMMETRY_POW_OFFSET <= e && e <= SYMMETRY_POW_OFFSET, cerr << e << endl;);
+        return symmetryPowTable[axis][SYMMETRY_POW_OFFSET + e];
+    }
+    
+    void initSymmetryHashTable(){
+        std::mt19937 dice(83);
+        auto rand64 = [&dice]()->uint64_t{ return (uint64_t(dice()) << 32) | dice(); };
+        for(int t = TILE_MIN; t <= TILE_MAX; ++t){
+            symmetryTileKey[t] = rand64();
+        }
+        for(int a = 0; a < 2; ++a){
+            const uint64_t base = rand64() | 1ULL;
+            // 2^64 を法とした逆元(Newton 法)
+            uint64_t inv = base;
+            for(int i = 0; i < 5; ++i){
+                inv *= 2 - base * inv;
+            }
+            ASSERT(base * inv == 1ULL,);
+            symmetryPowTable[a][SYMMETRY_POW_OFFSET] = 1ULL;
+            for(int e = 1; e <= SYMMETRY_POW_OFFSET; ++e){
+                symmetryPowTable[a][SYMMETRY_POW_OFFSET + e] = symmetryPowTable[a][SYMMETRY_POW_OFFSET + e - 1] * base;
+                symmetryPowTable[a][SYMMETRY_POW_OFFSET - e] = symmetryPowTable[a][SYMMETRY_POW_OFFSET - e + 1] * inv;
             }
         }
     }
     
+    template<int kSign, class hash_t>
+    void updateSymmetryHash(hash_t& symHash, int x, int y, Tile tile)noexcept{
+        // 絶対座標 (x, y) にタイルを置く(kSign = -1 なら取り除く)ときの差分
+        // 対称変換の線形部分だけをかけておき、平行移動分は calcRepRelativeHash で掛ける
+        iterateSymmetries(x, y, 0, 0,
+                          [tile, &symHash](int s, int u, int v)->void{
+                              const uint64_t h = symmetryTileKey[getSymmetryTile(tile, s)]
+                              * symmetryPow(0, u) * symmetryPow(1, v);
+                              symHash[s] += (kSign > 0) ? h : (0ULL - h);
+                          });
+    }
+    
+    void initHashTable(){
+        // 絶対座標の Zobrist キーは tileHashKey() で計算するので、表が必要なのは対称ハッシュ値のみ
+        initSymmetryHashTable();
+    }
+    
     int connectedEnd(int baseZ, int dstZ)noexcept{
         // baseZ と dstZ が近接関係にあるとき
         // dstZ が baseZ のどのエンドと接続するか
@@ -1039,48 +1109,26 @@ namespace Trax{
     
     template<class board_t>
     Move toMove(const RelativeMove& rmv, const board_t& bd){
-        return Move(XYtoZ(bd.lx() - 1 + rmv.x(), bd.ly() - 1 + rmv.y()), rmv.tile());
+        return Move(board_t::XYtoZ(bd.lx() - 1 + rmv.x(), bd.ly() - 1 + rmv.y()), rmv.tile());
     }
     
     template<class board_t>
     RelativeMove toRelativeMove(const Move& mv, const board_t& bd){
-        return RelativeMove(ZtoX(mv.z()) - bd.lx() + 1, ZtoY(mv.z()) - bd.ly() + 1, mv.tile());
+        return RelativeMove(board_t::ZtoX(mv.z()) - bd.lx() + 1, board_t::ZtoY(mv.z()) - bd.ly() + 1, mv.tile());
     }
     
     /**************************対称性の考慮**************************/
     
-    template<class board_t>
-    uint64_t calcRepRelativeHash(const board_t& bd, const Color color, int& pattern){
-        // 定跡のため、平行移動と回転を考慮したハッシュ値を計算
-        // どちらの手番かの情報は一応後でも入れられるようにしておく
-        // TODO: タイルの回転処理にテーブル参照が入るので他の方法の方がいいかも?
-        uint64_t rhash[8] = {0};
-        const int dx = bd.dx(), dy = bd.dy();
-        for(int i = 0; i <= dx; ++i){
-            for(int j = 0; j <= dy; ++j){
-                int x = bd.lx() + i;
-                int y = bd.ly() + j;
-                Tile tile = bd.tile(XYtoZ(x, y));
-                if(isTile(tile)){ // 空でないときのみ
-                    // ノーテーションの位置と合わせて対称型をとる
-                    iterateSymmetries(i + 1, j + 1, dx + 2, dy + 2,
-                                      [tile, &rhash](int s, int u, int v)->void{
-                                          // sが対称型のタイプ
-                                          // u, vが新しい座標
-                                          DERR << s << " (" << u << ", " << v << ") ";
-                                          // 盤面の最大サイズによってハッシュ値がかわらないように一次元化
-                                          int index = cartesian(u, v);
-                                          // 反転回転させたタイル
-                                          Tile t = getSymmetryTile(tile, s);
-                                          DERR << t << endl;
-                                          rhash[s] ^= tileHashTable[index][t];
-                                      });
-                }
-            }
-        }
-        for(int s = 0; s < 8; ++s){
-            DERR << rhash[s] << " ";
-        }DERR << endl;
+    uint64_t calcRepRelativeHash(const std::array<uint64_t, 8>& symHash,
+                                 int lx, int ly, int hx, int hy, Color turnColor, int& pattern){
+        // 絶対座標基準の対称ハッシュ値とタイルの境界から代表ハッシュ値を計算
+        // 原点の変換先の分の冪を掛けてノーテーション基準の相対座標に直す
+        uint64_t rhash[8];
+        iterateSymmetries(1 - lx, 1 - ly, hx - lx + 2, hy - ly + 2,
+                          [&symHash, &rhash](int s, int u, int v)->void{
+                              // 多項式ハッシュは下位ビットの質が悪いので置換表に使う前に攪拌する
+                              rhash[s] = mixHash64(symHash[s] * symmetryPow(0, u) * symmetryPow(1, v));
+                          });
         
         // 最小のハッシュ値を代表として採用する
         // このときどの対称パターンが採用されたか返す(定跡データから戻すときに必要)
@@ -1093,13 +1141,53 @@ namespace Trax{
                 pattern = s;
             }
         }
-        return (repHash & (~1ULL)) | bd.turnColor(); // 色情報をまぜる
+        return (repHash & (~1ULL)) | turnColor; // 色情報をまぜる
+    }
+    
+    template<class board_t>
+    uint64_t calcRepRelativeHash(const board_t& bd, const Color color, int& pattern){
+        // 定跡のため、平行移動と回転を考慮したハッシュ値を計算
+        // どちらの手番かの情報は一応後でも入れられるようにしておく
+        // 盤面側で絶対座標の対称ハッシュ値を差分計算しているので、ここでは相対化するだけでよい
+        return calcRepRelativeHash(bd.symmetryHash, bd.lx(), bd.ly(), bd.hx(), bd.hy(), bd.turnColor(), pattern);
     }
     template<class board_t>
     uint64_t calcRepRelativeHash(const board_t& bd, int& pattern){
         return calcRepRelativeHash(bd, bd.turnColor(), pattern);
     }
     
+    template<class board_t>
+    uint64_t predictRepRelativeHash(const board_t& bd, const Move& mv){
+        // 着手後の局面の代表ハッシュ値の予測(置換表のプリフェッチ用)
+        // 着手したタイルの分だけを足すので、強制手でタイルが置かれる場合は外れる
+        std::array<uint64_t, 8> symHash = bd.symmetryHash;
+        const int x = board_t::ZtoX(mv.z()), y = board_t::ZtoY(mv.z());
+        updateSymmetryHash<+1>(symHash, x, y, mv.tile());
+        int pattern;
+        return calcRepRelativeHash(symHash, min(bd.lx(), x), min(bd.ly(), y), max(bd.hx(), x), max(bd.hy(), y),
+                                   flipColor(bd.turnColor()), pattern);
+    }
+    
+    uint64_t calcRelativeHash(const std::array<uint64_t, 8>& symHash, int lx, int ly, Color turnColor){
+        // 平行移動だけを考慮したハッシュ値(対称パターン 0 の相対化)
+        // 絶対座標のハッシュ値と違って盤面の大きさによらず、代表ハッシュ値と違って回転や反転は区別する
+        return (mixHash64(symHash[0] * symmetryPow(0, 1 - lx) * symmetryPow(1, 1 - ly)) & (~1ULL)) | turnColor;
+    }
+    template<class board_t>
+    uint64_t calcRelativeHash(const board_t& bd){
+        return calcRelativeHash(bd.symmetryHash, bd.lx(), bd.ly(), bd.turnColor());
+    }
+    
+    template<class board_t>
+    uint64_t predictRelativeHash(const board_t& bd, const Move& mv){
+        // 着手後の局面の平行移動だけを考慮したハッシュ値の予測(評価点キャッシュのプリフェッチ用)
+        // こちらも強制手でタイルが置かれる場合は外れる
+        std::array<uint64_t, 8> symHash = bd.symmetryHash;
+        const int x = board_t::ZtoX(mv.z()), y = board_t::ZtoY(mv.z());
+        updateSymmetryHash<+1>(symHash, x, y, mv.tile());
+        return calcRelativeHash(symHash, min(bd.lx(), x), min(bd.ly(), y), flipColor(bd.turnColor()));
+    }
+    
     RelativeMoveBound symmetryTransform(const RelativeMoveBound& mv, const int pattern){
         // 対称変換
         ASSERT(0 <= pattern && pattern < 8, cerr << pattern << endl;);
@@ -1124,6 +1212,28 @@ namespace Trax{
         return symmetryTransform(mv, invSymmetryTable[pattern]);
     }
     
+    // 対称型での相対座標の着手を Move に詰める時の印
+    // 空の盤面では初手が相対座標 (0, 0) になるので、kMoveNone と区別するために立てておく
+    constexpr uint32_t SYMMETRY_MOVE_FLAG = 1U << 16;
+    
+    template<class board_t>
+    Move toSymmetryMove(const Move& mv, const board_t& bd, const int pattern){
+        // 対称性を考慮した置換表に保存するため、着手を対称型 pattern での相対座標に変換
+        if(mv == kMoveNone){ return kMoveNone; }
+        RelativeMoveBound rmv = symmetryTransform(RelativeMoveBound(toRelativeMove(mv, bd), bd.dx() + 2, bd.dy() + 2), pattern);
+        return Move(SYMMETRY_MOVE_FLAG | (rmv.x() << 8) | rmv.y(), rmv.tile());
+    }
+    template<class board_t>
+    Move fromSymmetryMove(const Move& smv, const board_t& bd, const int pattern){
+        // toSymmetryMove の逆変換
+        if(smv == kMoveNone){ return kMoveNone; }
+        const int mx = (pattern < 4) ? (bd.dx() + 2) : (bd.dy() + 2);
+        const int my = (pattern < 4) ? (bd.dy() + 2) : (bd.dx() + 2);
+        const int x = (smv.z() >> 8) & 255, y = smv.z() & 255;
+        if(x > mx || y > my){ return kMoveNone; } // 別局面のデータ
+        return toMove(invSymmetryTransform(RelativeMoveBound(x, y, mx, my, static_cast<Tile>(smv.tile())), pattern), bd);
+    }
+    
     /**************************ノーテーション読み**************************/
     
     RelativeMove readRelativeMoveNotation(const std::string& str){
@@ -1190,7 +1300,7 @@ namespace Trax{
     
     template<class board_t>
     std::string toNotationString(const Move& mv, const board_t& bd){
-        return toNotationString(ZtoX(mv.z()), ZtoY(mv.z()), bd.lx(), bd.ly()) + toTileString(mv.tile());
+        return toNotationString(board_t::ZtoX(mv.z()), board_t::ZtoY(mv.z()), bd.lx(), bd.ly()) + toTileString(mv.tile());
     }
     std::string toNotationString(const RelativeMove& mv){
         return toNotationString(mv.x(), mv.y(), 1, 1) + toTileString(mv.tile());
@@ -1199,7 +1309,7 @@ namespace Trax{
     // 拡張ノーテーション(タイルの色付き)への変換
     template<class board_t>
     std::string toExpandedNotationString(const Move& mv, const board_t& bd){
-        return toNotationString(ZtoX(mv.z()), ZtoY(mv.z()), bd.lx(), bd.ly()) + toTileString(mv.tile()) + toColorString(toTopColor(mv.tile()));
+        return toNotationString(board_t::ZtoX(mv.z()), board_t::ZtoY(mv.z()), bd.lx(), bd.ly()) + toTileString(mv.tile()) + toColorString(toTopColor(mv.tile()));
     }
     std::string toExpandedNotationString(const RelativeMove& mv){
         return toNotationString(mv.x(), mv.y() , 1, 1) + toTileString(mv.tile()) + toColorString(toTopColor(mv.tile()));
@@ -8,6 +8,12 @@
 
 #include "trax.hpp"
 #include "board.hpp"
+#include "board8x8.hpp"
+#include "book.hpp"
+#include "node.hpp"
+#include "learn.hpp"
+#include "perft.hpp"
+#include "logger.hpp"
 
 using namespace std;
 using namespace Trax;
@@ -89,7 +95,7 @@ int testSymmetry(){
     uint64_t hash[TILE_MAX + 1];
     for(int t = TILE_MIN; t <= TILE_MAX; ++t){
         bd.clear();
-        bd.template makeMove<true>(Move(Z_FIRST, t)); // force put
+        bd.template makeMove<true>(Move(board_t::Z_FIRST, t)); // force put
         uint64_t thash = calcRepRelativeHash(bd, WHITE, pat);
         hash[t] = thash;
         
@@ -144,6 +150,52 @@ int testSymmetry(){
             return -1;
         }
     }
+    
+    // random games and their symmetric games must have the same hash values
+    // (forced tiles are also placed symmetrically since the first tile is on the center)
+    constexpr int c = board_t::ZtoX(board_t::Z_FIRST);
+    board_t *psbd = new board_t[8];
+    XorShift64 dice;
+    dice.srand(31);
+    for(int g = 0; g < 20; ++g){
+        for(int s = 0; s < 8; ++s){
+            psbd[s].clear();
+        }
+        while(true){
+            std::vector<Move> moves = generateMoveVector(psbd[0]);
+            if(moves.empty()){ break; }
+            const Move mv = moves[dice.rand() % moves.size()];
+            // the predicted key is exact when no forced tile is placed
+            const uint64_t predicted = predictRepRelativeHash(psbd[0], mv);
+            const int tiles = psbd[0].moves;
+            int ret = 0;
+            iterateSymmetries(board_t::ZtoX(mv.z()) - c, board_t::ZtoY(mv.z()) - c, 0, 0,
+                              [&](int s, int u, int v)->void{
+                                  Move smv(board_t::XYtoZ(c + u, c + v), getSymmetryTile(mv.tile(), s));
+                                  // 初手の向きの制限は対称変換で崩れるので強制的に置く
+                                  int sret = (psbd[s].turn == 0) ? psbd[s].template makeMove<true>(smv) : psbd[s].makeMove(smv);
+                                  ret = (s == 0 || sret == ret) ? sret : Rule::OUT_BOARD;
+                              });
+            if(ret < 0){
+                cerr << "failed symmetric move in random game." << endl;
+                return -1;
+            }
+            uint64_t hash0 = calcRepRelativeHash(psbd[0], pat);
+            if(psbd[0].moves == tiles + 1 && hash0 != predicted){
+                cerr << "failed child hash prediction." << endl;
+                return -1;
+            }
+            for(int s = 1; s < 8; ++s){
+                if(calcRepRelativeHash(psbd[s], pat) != hash0){
+                    cerr << "failed random game symmetry-hash test." << endl;
+                    cerr << psbd[0].toString() << psbd[s].toString();
+                    return -1;
+                }
+            }
+            if(ret & (Rule::WON << WHITE | Rule::WON << RED)){ break; }
+        }
+    }
+    delete[](psbd);
     delete(pbd);
     
     return 0;
@@ -210,6 +262,28 @@ int testLongUnmakeConsistency(const board_t& bd, const record_t& r){
     return 0;
 }
 
+template<class board_t>
+int testSyncConsistency(const board_t& bd, const board_t& root){
+    // does syncWith() reproduce the root board?
+    board_t *pbd = new board_t();
+    board_t& tbd = *pbd;
+    tbd = bd;
+    tbd.syncWith(root);
+    int err = 0;
+    if(!tbd.exam(false)){ cerr << "failed validation" << endl; err = 1; }
+    if(!root.template equals<1>(tbd) || err){
+        cerr << " *** ORIGINAL BOARD *** " << endl;
+        cerr << bd.toString();
+        cerr << " *** ROOT BOARD *** " << endl;
+        cerr << root.toString();
+        cerr << " *** SYNCHRONIZED BOARD *** " << endl;
+        cerr << tbd.toString();
+        return -1;
+    }
+    delete(pbd);
+    return 0;
+}
+
 template<class board_t>
 int testLegalityCheckConsistency(const board_t& bd){
     // is isLegalMove() saves board state?
@@ -404,6 +478,58 @@ int testBoard(){
     }
     cerr << "passed long make - unmake consistency test." << endl;
     
+    // synchronization test
+    for(int i = 0; i < sample.size(); ++i){
+        // 1手ずつ進む場合と、別の棋譜の局面からの場合
+        const auto& other = sample[(i + 1) % sample.size()];
+        board_t *pbd = new board_t();
+        board_t& bd = *pbd;
+        board_t *pobd = new board_t();
+        board_t& obd = *pobd;
+        bd.clear();
+        obd.clear();
+        for(int j = 0; j < other.size(); ++j){
+            obd.makeMove(readMoveNotation(other[j], obd));
+        }
+        board_t *psbd = new board_t();
+        board_t& sbd = *psbd;
+        sbd = bd;
+        BoardT<64> *pnbd = new BoardT<64>(); // 小さい盤面への同期
+        BoardT<64>& nbd = *pnbd;
+        nbd.clear();
+        for(int j = 0; j < sample[i].size(); ++j){
+            bd.makeMove(readMoveNotation(sample[i][j], bd));
+            if(testSyncConsistency(sbd, bd) || testSyncConsistency(obd, bd)){
+                cerr << "failed synchronization test." << endl;
+                return -1;
+            }
+            sbd.syncWith(bd);
+            const bool synced = nbd.syncWith(bd);
+            if(synced != (nbd.turn == bd.turn)){
+                cerr << "narrow board synchronization was not reported correctly." << endl;
+                return -1;
+            }
+            if(synced){ // 盤外に出た場合は比較しない
+                int pat0, pat1;
+                if(!nbd.exam(false)
+                   || nbd.toRawBoardString() != bd.toRawBoardString()
+                   || calcRepRelativeHash(nbd, pat0) != calcRepRelativeHash(bd, pat1)){
+                    cerr << " *** ROOT BOARD *** " << endl;
+                    cerr << bd.toString();
+                    cerr << " *** NARROW BOARD *** " << endl;
+                    cerr << nbd.toString();
+                    cerr << "failed synchronization test." << endl;
+                    return -1;
+                }
+            }
+        }
+        delete(pbd);
+        delete(pobd);
+        delete(psbd);
+        delete(pnbd);
+    }
+    cerr << "passed synchronization test." << endl;
+    
     // legality check test
     for(int i = 0; i < sample.size(); ++i){
         board_t *pbd = new board_t();
@@ -475,6 +601,391 @@ int testBoard(){
     return 0;
 }
 
+int testBook(){
+    // write book moves of random games and read them on symmetric games
+    constexpr int c = Board::ZtoX(Board::Z_FIRST);
+    const std::string path = "./book_test.bin";
+    std::unique_ptr<Board[]> pbd(new Board[2]);
+    Board& bd = pbd[0];
+    Board& sbd = pbd[1];
+    XorShift64 dice;
+    dice.srand(36);
+    
+    auto symmetryMove = [c](const Move& mv, int pattern)->Move{
+        Move smv = kMoveNone;
+        iterateSymmetries(Board::ZtoX(mv.z()) - c, Board::ZtoY(mv.z()) - c, 0, 0,
+                          [&](int s, int u, int v)->void{
+                              if(s == pattern){
+                                  smv = Move(Board::XYtoZ(c + u, c + v), getSymmetryTile(mv.tile(), s));
+                              }
+                          });
+        return smv;
+    };
+    auto play = [](Board& b, const Move& mv)->int{
+        return (b.turn == 0) ? b.makeMove<true>(mv) : b.makeMove(mv);
+    };
+    
+    constexpr int kGames = 20;
+    std::vector<std::vector<Move>> games;
+    std::map<uint64_t, std::vector<BookMove>> book;
+    for(int g = 0; g < kGames; ++g){
+        bd.clear();
+        games.emplace_back();
+        for(int t = 0; t < 10; ++t){
+            std::vector<Move> moves = generateMoveVector(bd);
+            if(moves.empty()){ break; }
+            const Move mv = moves[dice.rand() % moves.size()];
+            int pat;
+            const uint64_t key = calcRepRelativeHash(bd, pat);
+            if(!book.count(key)){
+                book[key].push_back(BookMove(toSymmetryMove(mv, bd, pat), t, 1));
+            }
+            games.back().push_back(mv);
+            if(play(bd, mv) & (Rule::WON << WHITE | Rule::WON << RED)){ break; }
+        }
+    }
+    Book rbook;
+    if(!Book::write(path, book) || !rbook.open(path) || rbook.size() != book.size()){
+        cerr << "failed to write and open book." << endl;
+        return -1;
+    }
+    remove(path.c_str());
+    
+    for(int g = 0; g < kGames; ++g){
+        const int pattern = g % 8;
+        bd.clear();
+        sbd.clear();
+        for(const Move& mv : games[g]){
+            // the book moves on both boards should lead to the same position
+            const Move bmv = rbook.probe(bd);
+            const Move sbmv = rbook.probe(sbd);
+            if(bmv == kMoveNone || sbmv == kMoveNone){
+                cerr << "position not found in book." << endl;
+                return -1;
+            }
+            int pat;
+            play(bd, bmv);
+            play(sbd, sbmv);
+            const uint64_t h = calcRepRelativeHash(bd, pat), sh = calcRepRelativeHash(sbd, pat);
+            bd.unmakeMove();
+            sbd.unmakeMove();
+            if(h != sh){
+                cerr << "inconsistent book move " << toNotationString(bmv, bd) << " <-> " << toNotationString(sbmv, sbd) << endl;
+                cerr << bd.toString() << sbd.toString();
+                return -1;
+            }
+            play(bd, mv);
+            play(sbd, symmetryMove(mv, pattern));
+        }
+    }
+    return 0;
+}
+
+int testEvalParams(){
+    // write parameters to a binary file, load them and reject a broken file
+    const std::string path = "./eval_params_test.dat";
+    std::vector<int> values(kNumEvalParams);
+    for(int i = 0; i < kNumEvalParams; ++i){
+        values[i] = -eval_params[i];
+    }
+    if(!EvalParams::write(path, values.data()) || !evalParams.load(path)){
+        cerr << "failed to write and load parameters." << endl;
+        return -1;
+    }
+    for(int i = 0; i < kNumEvalParams; ++i){
+        if(evalParams[i] != -eval_params[i]){
+            cerr << "inconsistent parameter " << i << " " << evalParams[i] << " <-> " << -eval_params[i] << endl;
+            return -1;
+        }
+    }
+    // a truncated file should not change the parameters
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        EvalParamsHeader header;
+        memcpy(header.magic, EvalParams::kMagic, sizeof(header.magic));
+        header.version = EvalParams::kVersion;
+        header.params = kNumEvalParams;
+        header.reserved = 0;
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    const bool loaded = evalParams.load(path);
+    remove(path.c_str());
+    if(loaded || evalParams[0] != -eval_params[0]){
+        cerr << "loaded a broken parameter file." << endl;
+        return -1;
+    }
+    evalParams.setDefault();
+    for(int i = 0; i < kNumEvalParams; ++i){
+        if(evalParams[i] != eval_params[i]){
+            cerr << "failed to restore default parameters." << endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int testTeacherFeatures(){
+    // sparse features for learning should reproduce the static evaluation
+    TraxNode<Board> *pnd = new TraxNode<Board>;
+    TraxNode<Board>& nd = *pnd;
+    XorShift64 dice;
+    dice.srand(39);
+    std::vector<TeacherFeature> fv;
+    std::vector<int> evals;
+    std::vector<char> buffer;
+    for(int g = 0; g < 30; ++g){
+        nd.clear();
+        for(int t = 0; t < 40; ++t){
+            fv.clear();
+            extractFeatures(nd, &fv);
+            const int ev = evaluateFeatures(fv.data(), fv.size(), evalParams);
+            const int nev = nd.evaluate(nd.turnColor());
+            if(ev != nev){
+                cerr << "inconsistent feature evaluation " << ev << " <-> " << nev << endl;
+                cerr << nd.toString();
+                return -1;
+            }
+            TeacherPosition pos = {static_cast<int16_t>(ev), 0, static_cast<uint8_t>(t), static_cast<uint16_t>(fv.size()), 0};
+            TeacherWriter::append(&buffer, pos, fv.data());
+            evals.push_back(ev);
+            std::vector<Move> moves = generateMoveVector<Move, true>(nd);
+            if(moves.empty()){ break; }
+            const Move mv = moves[dice.rand() % moves.size()];
+            if(nd.makeMove(mv) != 0){ break; }
+        }
+    }
+    delete pnd;
+    
+    // write the positions and read them back
+    const std::string path = "./teacher_test.bin";
+    remove(path.c_str());
+    TeacherWriter writer;
+    TeacherData data;
+    if(!writer.open(path)){
+        cerr << "failed to open teacher file." << endl;
+        return -1;
+    }
+    writer.write(buffer);
+    writer.close();
+    const bool loaded = loadTeacherFile(path, &data);
+    remove(path.c_str());
+    if(!loaded || data.size() != evals.size()){
+        cerr << "failed to load teacher file." << endl;
+        return -1;
+    }
+    for(size_t i = 0; i < data.size(); ++i){
+        const int ev = evaluateFeatures(data.featuresOf(i), data.positions[i].features, evalParams);
+        if(ev != evals[i] || data.positions[i].score != evals[i]){
+            cerr << "inconsistent teacher position " << i << endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+template<class board_t>
+uint64_t countLegalLeaves(board_t& bd, int depth){
+    // reference count of perft leaves with the legal move generator
+    uint64_t cnt = 0;
+    for(const Move& mv : generateMoveVector<Move, true>(bd)){
+        const int ret = bd.makeMove(mv);
+        if(ret < 0){ continue; }
+        if(depth == 1){
+            cnt += 1;
+        }else if(ret == 0){
+            cnt += countLegalLeaves(bd, depth - 1);
+        }
+        bd.unmakeMove();
+    }
+    return cnt;
+}
+
+int testPerft(){
+    // serial, parallel and table-backed perft should count the same tree
+    Board *pbd = new Board;
+    Board& bd = *pbd;
+    bd.clear();
+    if(perft(bd, 1).leaves != 2){
+        cerr << "wrong perft(1) " << perft(bd, 1).leaves << endl;
+        return -1;
+    }
+    PerftTable table;
+    table.SetSize(16);
+    for(int depth = 1; depth <= 3; ++depth){
+        const PerftResult serial = perft(bd, depth);
+        const PerftResult parallel = parallelPerft(bd, depth, 3);
+        const PerftResult hashed = perft(bd, depth, &table);
+        const PerftResult hashed2 = parallelPerft(bd, depth, 3, &table);
+        const uint64_t legal = countLegalLeaves(bd, depth);
+        if(!(serial == parallel) || !(serial == hashed) || !(serial == hashed2) || serial.leaves != legal){
+            cerr << "inconsistent perft(" << depth << ") " << serial.leaves << " " << parallel.leaves
+            << " " << hashed.leaves << " " << hashed2.leaves << " " << legal << endl;
+            return -1;
+        }
+    }
+    delete pbd;
+    return 0;
+}
+
+int testLogger(){
+    // messages pushed from several threads should all be written in per-thread order
+    const std::string path = "./trax_test_communication.log";
+    const std::string errorPath = "./trax_test_error.log";
+    std::remove(path.c_str());
+    std::remove(errorPath.c_str());
+    const int threads = 4, messages = 1000;
+    std::unique_ptr<Logger> plogger(new Logger);
+    plogger->start(path, errorPath);
+    std::vector<std::thread> writers;
+    for(int th = 0; th < threads; ++th){
+        writers.emplace_back([&, th]()->void{
+            for(int i = 0; i < messages; ++i){
+                plogger->push(kLogInfo, kLogCommunication, std::to_string(th) + " " + std::to_string(i) + "\n");
+            }
+        });
+    }
+    for(std::thread& writer : writers){
+        writer.join();
+    }
+    const uint64_t dropped = plogger->dropped();
+    plogger->stop();
+    std::ifstream ifs(path);
+    std::vector<int> last(threads, -1);
+    uint64_t lines = 0;
+    for(int pid, th, i; ifs >> pid >> th >> i; ++lines){
+        if(th < 0 || th >= threads || i <= last[th]){
+            cerr << "broken log line " << th << " " << i << endl;
+            return -1;
+        }
+        last[th] = i;
+    }
+    std::remove(path.c_str());
+    std::remove(errorPath.c_str());
+    if(lines + dropped != uint64_t(threads * messages)){
+        cerr << "lost log lines " << lines << " + " << dropped << endl;
+        return -1;
+    }
+    return 0;
+}
+
+int testHashKey(){
+    // Zobrist keys computed from (z, tile) should be distinct over the whole board
+    std::vector<uint64_t> keys;
+    for(int z = 0; z < SIZE * SIZE; ++z){
+        for(int t = TILE_MIN; t <= TILE_MAX; ++t){
+            keys.push_back(tileHashKey(z, t));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    if(std::adjacent_find(keys.begin(), keys.end()) != keys.end()){
+        cerr << "duplicated Zobrist key." << endl;
+        return -1;
+    }
+    return 0;
+}
+
+int test8x8Board(){
+    // 8x8 bitboard implementation test
+    // compare all moves of random games with the unbounded board
+    constexpr int kGames = 200;
+    XorShift64 dice;
+    dice.srand(8);
+    Board8x8 *pbd8 = new Board8x8();
+    Board8x8& bd8 = *pbd8;
+    Board *pbd = new Board();
+    Board& bd = *pbd;
+    Board8x8 *ptbd8 = new Board8x8();
+    Board8x8& tbd8 = *ptbd8;
+    
+    auto Foo = [&](const Move& mv)->void{
+        cerr << " *** 8x8 BOARD *** (" << toNotationString(mv, bd8) << ")" << endl;
+        cerr << bd8.toString();
+        cerr << " *** UNBOUNDED BOARD *** " << endl;
+        cerr << bd.toString();
+    };
+    
+    for(int g = 0; g < kGames; ++g){
+        bd8.clear();
+        bd.clear();
+        while(true){
+            std::vector<Move> legalMoves;
+            tbd8 = bd8;
+            for(Move mv : generateMoveVector(bd8)){
+                // 8x8 に収まる着手は無制限の盤面と同じ結果になるはず
+                int ret8 = bd8.makeMove(mv);
+                int ret = bd.makeMove(convertMove<Board8x8::size(), SIZE>(mv));
+                if((ret8 < 0) != (ret < 0) || (ret8 >= 0 && ret8 != ret)){
+                    cerr << "result " << ret8 << " != " << ret << endl;
+                    if(ret8 >= 0){ Foo(mv); }
+                    return -1;
+                }
+                if(ret8 >= 0){
+                    int pat0, pat1;
+                    if(!bd8.exam(false)
+                       || bd8.moves != bd.moves || bd8.dx() != bd.dx() || bd8.dy() != bd.dy()
+                       || calcRepRelativeHash(bd8, pat0) != calcRepRelativeHash(bd, pat1)){
+                        Foo(mv);
+                        return -1;
+                    }
+                    legalMoves.push_back(mv);
+                    bd8.unmakeMove();
+                    bd.unmakeMove();
+                }
+                if(!bd8.template equals<1>(tbd8)){
+                    cerr << "failed make - unmake consistency." << endl;
+                    return -1;
+                }
+            }
+            // 線の番号まで無制限の盤面と揃うので、評価の特徴は完全に一致するはず
+            // アタックは 8x8 の外に置くものを数えないので、範囲が制限にかからない間だけ一致する
+            bd8.checkSetAttacks();
+            bd.checkSetAttacks();
+            EvalFeatures features8, features;
+            features8.clear();
+            features.clear();
+            bd8.updateEvalInfo(&features8);
+            bd.updateEvalInfo(&features);
+            if(bd8.lines != bd.lines
+               || bd8.threats != bd.threats || bd8.longLines != bd.longLines
+               || bd8.lineShapeScore != bd.lineShapeScore
+               || bd8.twoLinesFrontShapeScore != bd.twoLinesFrontShapeScore
+               || features8.lineShape != features.lineShape
+               || features8.twoLinesFrontShape != features.twoLinesFrontShape){
+                cerr << "inconsistent evaluation features." << endl;
+                cerr << bd8.toString();
+                return -1;
+            }
+            for(int c = 0; c < 2; ++c){
+                const Color col = static_cast<Color>(c);
+                const bool unbounded = bd.dx() < Board8x8::WIDTH - 1 && bd.dy() < Board8x8::WIDTH - 1;
+                if((unbounded && (bd8.attacks[c] != bd.attacks[c]
+                                  || bd8.hasInevasibleAttacks(col) != bd.hasInevasibleAttacks(col)))
+                   || bd8.attacks[c] > bd.attacks[c]){
+                    cerr << "inconsistent attacks " << bd8.attacks[c] << " " << bd.attacks[c] << endl;
+                    cerr << bd8.toString();
+                    return -1;
+                }
+            }
+            if(legalMoves.empty()){ break; } // 引き分け
+            Move mv = legalMoves[dice.rand() % legalMoves.size()];
+            int ret = bd8.makeMove(mv);
+            bd.makeMove(convertMove<Board8x8::size(), SIZE>(mv));
+            if(ret > 0){ break; }
+        }
+        // 同期
+        tbd8.clear();
+        tbd8.syncWith(bd);
+        if(!tbd8.template equals<1>(bd8)){
+            cerr << "failed 8x8 synchronization." << endl;
+            return -1;
+        }
+    }
+    delete(pbd8);
+    delete(pbd);
+    delete(ptbd8);
+    return 0;
+}
+
 template<class board_t>
 int moveGeneratorTest(){
     // check whether exactly same moves were generated
@@ -498,16 +1009,66 @@ int main(int argc, char* argv[]){
         return -1;
     }
     
-    // board implementation test
-    if(testBoard<Board>() < 0){
+    // Zobrist key test
+    if(testHashKey() < 0){
+        cerr << "failed hash key test." << endl;
+        return -1;
+    }
+    cerr << "passed hash key test." << endl;
+    
+    // perft test
+    if(testPerft() < 0){
+        cerr << "failed perft test." << endl;
+        return -1;
+    }
+    cerr << "passed perft test." << endl;
+    
+    // asynchronous logger test
+    if(testLogger() < 0){
+        cerr << "failed logger test." << endl;
         return -1;
     }
+    cerr << "passed logger test." << endl;
+    
+    // 8x8 board implementation test
+    if(test8x8Board() < 0){
+        cerr << "failed 8x8 board test." << endl;
+        return -1;
+    }
+    cerr << "passed 8x8 board test." << endl;
     
     // symmetry hash value test
-    if(testSymmetry<Board>() < 0){
+    if(testSymmetry<Board>() < 0 || testSymmetry<Board8x8>() < 0){
         cerr << "failed symmetry-hash test." << endl;
         return -1;
     }
+    cerr << "passed symmetry-hash test." << endl;
+    
+    // opening book test
+    if(testBook() < 0){
+        cerr << "failed book test." << endl;
+        return -1;
+    }
+    cerr << "passed book test." << endl;
+    
+    // evaluation parameter file test
+    if(testEvalParams() < 0){
+        cerr << "failed evaluation parameter test." << endl;
+        return -1;
+    }
+    cerr << "passed evaluation parameter test." << endl;
+    
+    // learning feature test
+    if(testTeacherFeatures() < 0){
+        cerr << "failed teacher feature test." << endl;
+        return -1;
+    }
+    cerr << "passed teacher feature test." << endl;
+    
+    // board implementation test
+    if(testBoard<Board>() < 0){
+        return -1;
+    }
     
     return 0;
 }
\ No newline at end of file